@@ -0,0 +1,226 @@
+#include "nyla/apps/wm/event_record.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "nyla/apps/wm/window_manager.h"
+#include "nyla/commons/os/clock.h"
+#include "nyla/platform/x11/platform_x11.h"
+#include "xcb/xcb.h"
+#include "xcb/xproto.h"
+
+namespace nyla
+{
+
+using namespace platform_x11_internal;
+
+WMRecorder wmRecorder;
+
+static constexpr char kWMRecordMagic[8] = {'N', 'Y', 'L', 'A', 'W', 'M', 'R', '5'};
+
+// The atoms are written as interned on the capture server, their number is part of the layout.
+struct WMRecordConfigPayload
+{
+    WMHideStrategy hideStrategy;
+    uint32_t motionRateCap;
+    xcb_window_t root;
+    uint16_t screenWidth;
+    uint16_t screenHeight;
+    uint8_t xi2MajorOpcode;
+    uint8_t randrFirstEvent;
+    uint8_t padding[2];
+    decltype(X11State::atoms) atoms;
+};
+
+struct WMRecordMonitor
+{
+    xcb_atom_t name;
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    uint32_t primary;
+};
+
+static void WriteRecord(WMRecordKind kind, const void *payload, uint32_t size, xcb_window_t window = 0,
+                        xcb_atom_t property = 0)
+{
+    const WMRecordHeader header{
+        .kind = kind,
+        .size = size,
+        .timeMicros = GetMonotonicTimeMicros(),
+        .window = window,
+        .property = property,
+    };
+    fwrite(&header, sizeof(header), 1, wmRecorder.file);
+    if (size)
+        fwrite(payload, size, 1, wmRecorder.file);
+}
+
+void WMRecorderOpen(const char *path)
+{
+    wmRecorder.file = fopen(path, "wb");
+    if (!wmRecorder.file)
+        LOG(QFATAL) << "could not open " << path << " for recording";
+
+    fwrite(kWMRecordMagic, sizeof(kWMRecordMagic), 1, wmRecorder.file);
+
+    // RandR events start past the core events, a first event of 0 means the server lacked RandR 1.5.
+    const WMRecordConfigPayload config{
+        .hideStrategy = wmHideStrategy,
+        .motionRateCap = wmMotionRateCap,
+        .root = x11.screen->root,
+        .screenWidth = x11.screen->width_in_pixels,
+        .screenHeight = x11.screen->height_in_pixels,
+        .xi2MajorOpcode = x11.extXi2->major_opcode,
+        .randrFirstEvent = x11.extRandr ? x11.extRandr->first_event : uint8_t{0},
+        .atoms = x11.atoms,
+    };
+    WriteRecord(WMRecordKind::KConfig, &config, sizeof(config));
+
+    LOG(INFO) << "recording events to " << path;
+}
+
+void WMRecordEvent(const xcb_generic_event_t *event)
+{
+    // xcb appends the extra data of generic events after full_sequence.
+    uint32_t size = sizeof(xcb_generic_event_t);
+    if ((event->response_type & 0x7F) == XCB_GE_GENERIC)
+        size += reinterpret_cast<const xcb_ge_generic_event_t *>(event)->length * 4;
+
+    WriteRecord(WMRecordKind::KEvent, event, size);
+}
+
+void WMRecordEventBatchEnd()
+{
+    WriteRecord(WMRecordKind::KEventBatchEnd, nullptr, 0);
+}
+
+void WMRecordPropertyReply(xcb_window_t window, xcb_atom_t property, const xcb_get_property_reply_t *reply)
+{
+    const uint32_t size = reply ? sizeof(xcb_get_property_reply_t) + reply->length * 4 : 0;
+    WriteRecord(WMRecordKind::KPropertyReply, reply, size, window, property);
+}
+
+void WMRecordProcessWM()
+{
+    WriteRecord(WMRecordKind::KProcessWM, nullptr, 0);
+    fflush(wmRecorder.file);
+}
+
+void WMRecordStartup(std::span<const xcb_window_t> adopted)
+{
+    WriteRecord(WMRecordKind::KStartup, adopted.data(), adopted.size_bytes());
+}
+
+void WMRecordHandoff(std::string_view state)
+{
+    WriteRecord(WMRecordKind::KHandoff, state.data(), state.size());
+}
+
+void WMRecordGeneratedId(xcb_window_t id)
+{
+    WriteRecord(WMRecordKind::KGeneratedId, nullptr, 0, id);
+}
+
+void WMRecordMonitors(std::span<const X11Monitor> monitors)
+{
+    std::vector<WMRecordMonitor> recorded;
+    recorded.reserve(monitors.size());
+    for (const X11Monitor &monitor : monitors)
+    {
+        recorded.emplace_back(WMRecordMonitor{
+            .name = monitor.name,
+            .x = monitor.x,
+            .y = monitor.y,
+            .width = monitor.width,
+            .height = monitor.height,
+            .primary = monitor.primary,
+        });
+    }
+    WriteRecord(WMRecordKind::KMonitors, recorded.data(), recorded.size() * sizeof(WMRecordMonitor));
+}
+
+auto WMRecordReaderOpen(const char *path) -> FILE *
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return nullptr;
+
+    char magic[sizeof(kWMRecordMagic)];
+    if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, kWMRecordMagic, sizeof(magic)))
+    {
+        fclose(file);
+        return nullptr;
+    }
+    return file;
+}
+
+auto WMRecordRead(FILE *file, WMRecord &record) -> bool
+{
+    if (fread(&record.header, sizeof(record.header), 1, file) != 1)
+        return false;
+
+    record.payload.resize(record.header.size);
+    if (record.header.size && fread(record.payload.data(), record.header.size, 1, file) != 1)
+        return false;
+
+    return true;
+}
+
+auto WMRecordApplyConfig(const WMRecord &record) -> bool
+{
+    WMRecordConfigPayload config;
+    if (record.header.kind != WMRecordKind::KConfig || record.payload.size() != sizeof(config))
+        return false;
+
+    memcpy(&config, record.payload.data(), sizeof(config));
+    wmHideStrategy = config.hideStrategy;
+    wmMotionRateCap = config.motionRateCap;
+
+    static xcb_screen_t screen;
+    static xcb_query_extension_reply_t extXi2;
+    static xcb_query_extension_reply_t extRandr;
+
+    screen.root = config.root;
+    screen.width_in_pixels = config.screenWidth;
+    screen.height_in_pixels = config.screenHeight;
+    extXi2.present = true;
+    extXi2.major_opcode = config.xi2MajorOpcode;
+    extRandr.present = true;
+    extRandr.first_event = config.randrFirstEvent;
+
+    x11.screen = &screen;
+    x11.extXi2 = &extXi2;
+    x11.extRandr = config.randrFirstEvent ? &extRandr : nullptr;
+    x11.atoms = config.atoms;
+    return true;
+}
+
+auto WMRecordReadMonitors(const WMRecord &record) -> std::vector<X11Monitor>
+{
+    std::vector<WMRecordMonitor> recorded(record.payload.size() / sizeof(WMRecordMonitor));
+    memcpy(recorded.data(), record.payload.data(), recorded.size() * sizeof(WMRecordMonitor));
+
+    std::vector<X11Monitor> monitors;
+    monitors.reserve(recorded.size());
+    for (const WMRecordMonitor &monitor : recorded)
+    {
+        monitors.emplace_back(X11Monitor{
+            .name = monitor.name,
+            .x = monitor.x,
+            .y = monitor.y,
+            .width = monitor.width,
+            .height = monitor.height,
+            .primary = monitor.primary != 0,
+        });
+    }
+    return monitors;
+}
+
+} // namespace nyla
\ No newline at end of file
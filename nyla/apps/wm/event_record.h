@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "nyla/platform/x11/platform_x11.h"
+#include "xcb/xcb.h"
+#include "xcb/xproto.h"
+
+namespace nyla
+{
+
+// Captures the raw event stream and property replies the WM receives, so a session can be replayed offline by
+// wm_replay. Records are written in host byte order and only meant to be read back on the same architecture. The first
+// record holds the options that change how the WM handles events and what it knew about the server, the root window,
+// atoms and extensions, wm_replay applies it before initializing the WM. Clients that existed before the capture
+// started come next, as a startup record with the adopted windows or a handoff record with the state of a hot restart,
+// and their initial property replies are captured as usual. Monitor queries and generated window ids are recorded
+// right when the WM makes them, replay reads them back at the same point.
+
+enum class WMRecordKind : uint8_t
+{
+    KEvent,
+    KEventBatchEnd,
+    KPropertyReply,
+    KProcessWM,
+    KStartup,
+    KHandoff,
+    KConfig,
+    KGeneratedId,
+    KMonitors,
+};
+
+struct WMRecordHeader
+{
+    WMRecordKind kind;
+    uint32_t size;
+    uint64_t timeMicros;
+    xcb_window_t window;
+    xcb_atom_t property;
+};
+
+struct WMRecord
+{
+    WMRecordHeader header;
+    std::vector<char> payload;
+};
+
+struct WMRecorder
+{
+    FILE *file;
+};
+extern WMRecorder wmRecorder;
+
+// Called once the options are parsed and the server is set up, both go into the config record.
+void WMRecorderOpen(const char *path);
+
+void WMRecordEvent(const xcb_generic_event_t *event);
+void WMRecordEventBatchEnd();
+void WMRecordPropertyReply(xcb_window_t window, xcb_atom_t property, const xcb_get_property_reply_t *reply);
+void WMRecordProcessWM();
+void WMRecordStartup(std::span<const xcb_window_t> adopted);
+void WMRecordHandoff(std::string_view state);
+void WMRecordGeneratedId(xcb_window_t id);
+void WMRecordMonitors(std::span<const platform_x11_internal::X11Monitor> monitors);
+
+auto WMRecordReaderOpen(const char *path) -> FILE *;
+auto WMRecordRead(FILE *file, WMRecord &record) -> bool;
+// Sets the options and the x11 state the core reads, no connection is made.
+auto WMRecordApplyConfig(const WMRecord &record) -> bool;
+auto WMRecordReadMonitors(const WMRecord &record) -> std::vector<platform_x11_internal::X11Monitor>;
+
+} // namespace nyla
\ No newline at end of file
@@ -100,6 +100,23 @@ auto ComputeLayout(const Rect &boundingRect, uint32_t n, uint32_t padding, Layou
     return out;
 }
 
+auto UpdateLayoutMemo(LayoutMemo &memo, const Rect &boundingRect, uint32_t n, uint32_t padding, LayoutType layoutType)
+    -> bool
+{
+    if (memo.boundingRect == boundingRect && memo.n == n && memo.padding == padding && memo.layoutType == layoutType &&
+        memo.rects.size() == n)
+    {
+        return false;
+    }
+
+    memo.boundingRect = boundingRect;
+    memo.n = n;
+    memo.padding = padding;
+    memo.layoutType = layoutType;
+    memo.rects = ComputeLayout(boundingRect, n, padding, layoutType);
+    return true;
+}
+
 auto TryApplyPadding(const Rect &rect, uint32_t padding) -> Rect
 {
     if (rect.Width() > 2 * padding && rect.Height() > 2 * padding)
@@ -115,4 +115,18 @@ void CycleLayoutType(LayoutType &layout);
 auto ComputeLayout(const Rect &boundingRect, uint32_t n, uint32_t padding, LayoutType layoutType = LayoutType::KColumns)
     -> std::vector<Rect>;
 
+struct LayoutMemo
+{
+    Rect boundingRect;
+    uint32_t n;
+    uint32_t padding;
+    LayoutType layoutType;
+
+    std::vector<Rect> rects;
+};
+
+// Returns false if memo.rects already holds the layout for these arguments.
+auto UpdateLayoutMemo(LayoutMemo &memo, const Rect &boundingRect, uint32_t n, uint32_t padding, LayoutType layoutType)
+    -> bool;
+
 } // namespace nyla
\ No newline at end of file
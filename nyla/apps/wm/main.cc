@@ -1,16 +1,31 @@
-#include <sys/poll.h>
+#include <linux/close_range.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <unistd.h>
 
+#include <charconv>
 #include <chrono>
+#include <climits>
 #include <cstdint>
+#include <cstdlib>
 #include <initializer_list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "absl/cleanup/cleanup.h"
 #include "absl/log/check.h"
 #include "absl/log/log.h"
+#include "nyla/apps/wm/event_record.h"
+#include "nyla/apps/wm/screen_saver_inhibitor.h"
 #include "nyla/apps/wm/window_manager.h"
+#include "nyla/apps/wm/wm_commands.h"
+#include "nyla/apps/wm/wm_dbus.h"
 #include "nyla/commons/logging/init.h"
+#include "nyla/commons/os/reactor.h"
 #include "nyla/commons/os/spawn.h"
 #include "nyla/commons/os/timerfd.h"
 #include "nyla/commons/signal/signal.h"
@@ -18,6 +33,7 @@
 #include "nyla/debugfs/debugfs.h"
 #include "nyla/platform/key_physical.h"
 #include "nyla/platform/x11/platform_x11.h"
+#include "nyla/platform/x11/platform_x11_audit.h"
 #include "xcb/xcb.h"
 #include "xcb/xproto.h"
 
@@ -26,6 +42,121 @@ namespace nyla
 
 using namespace platform_x11_internal;
 
+static bool restartRequested;
+static SpawnOptions spawnOptions;
+
+static void StartDebugFs(const std::string &path)
+{
+    DebugFsInitialize(path);
+    ReactorAdd(
+        debugfs.fd, EPOLLIN, ReactorTrigger::KLevel,
+        [](int fd, uint32_t events, void *data) -> void { DebugFsProcess(); }, nullptr);
+}
+
+// The fuse fd is likely to come back with the same number, so it has to leave the reactor before StartDebugFs can
+// register it again.
+static void StopDebugFs()
+{
+    ReactorRemove(debugfs.fd);
+    DebugFsShutdown();
+}
+
+// The top-level windows the WM finds when it starts, the attribute requests are all sent before the first reply is
+// waited on.
+static auto QueryExistingWindows() -> std::vector<WMExistingWindow>
+{
+    xcb_query_tree_reply_t *treeReply =
+        X11_BLOCKING(xcb_query_tree_reply(x11.conn, xcb_query_tree(x11.conn, x11.screen->root), nullptr));
+    if (!treeReply)
+        return {};
+    absl::Cleanup treeReplyFreer = [treeReply] -> void { free(treeReply); };
+
+    std::span<xcb_window_t> children = {xcb_query_tree_children(treeReply),
+                                        static_cast<size_t>(xcb_query_tree_children_length(treeReply))};
+
+    std::vector<xcb_get_window_attributes_cookie_t> attrCookies;
+    attrCookies.reserve(children.size());
+    for (xcb_window_t window : children)
+        attrCookies.emplace_back(xcb_get_window_attributes(x11.conn, window));
+
+    std::vector<WMExistingWindow> windows;
+    windows.reserve(children.size());
+    for (size_t i = 0; i < children.size(); ++i)
+    {
+        WMExistingWindow &existing = windows.emplace_back(WMExistingWindow{.window = children[i]});
+
+        // A window destroyed in the meantime has no attributes and is left alone like an unmapped one.
+        xcb_get_window_attributes_reply_t *attrReply =
+            X11_BLOCKING(xcb_get_window_attributes_reply(x11.conn, attrCookies[i], nullptr));
+        if (!attrReply)
+            continue;
+
+        existing.overrideRedirect = attrReply->override_redirect;
+        existing.mapped = attrReply->map_state != XCB_MAP_STATE_UNMAPPED;
+        free(attrReply);
+    }
+    return windows;
+}
+
+// Executes whatever binary is now at the path this one was started from, so a fresh build is picked up, and hands the
+// managed state over in an inherited memfd. Returns only if the restart failed.
+static void Restart(int argc, char **argv)
+{
+    char exe[PATH_MAX];
+    const ssize_t exeLength = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (exeLength < 0)
+    {
+        PLOG(ERROR) << "restart: could not resolve the executable";
+        return;
+    }
+
+    // A rebuilt binary replaces the file this process was executed from.
+    std::string path{exe, static_cast<size_t>(exeLength)};
+    if (path.ends_with(" (deleted)"))
+        path.resize(path.size() - std::string_view{" (deleted)"}.size());
+    if (access(path.c_str(), X_OK))
+    {
+        PLOG(ERROR) << "restart: " << path;
+        return;
+    }
+
+    const int fd = memfd_create("nyla-wm-handoff", 0);
+    if (fd < 0)
+    {
+        PLOG(ERROR) << "restart: memfd_create";
+        return;
+    }
+    absl::Cleanup fdCloser = [fd] -> void { close(fd); };
+
+    if (!WMHandoffSave(fd))
+        return;
+    // The save-set changes have to be processed before the connection closes.
+    free(X11_BLOCKING(xcb_get_input_focus_reply(x11.conn, xcb_get_input_focus(x11.conn), nullptr)));
+
+    std::string restoreArg = "--restore-fd=" + std::to_string(fd);
+    std::vector<char *> args{path.data()};
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if (!arg.starts_with("--restore-fd=") && !arg.starts_with("--record="))
+            args.emplace_back(argv[i]);
+    }
+    args.emplace_back(restoreArg.data());
+    args.emplace_back(nullptr);
+
+    // The X connection has to close for the new process to take over the root window, everything else goes too.
+    close_range(3, fd - 1, CLOSE_RANGE_CLOEXEC);
+    close_range(fd + 1, ~0U, CLOSE_RANGE_CLOEXEC);
+    StopDebugFs();
+
+    LOG(INFO) << "restarting " << path;
+    execve(path.c_str(), args.data(), environ);
+
+    PLOG(ERROR) << "restart: execve " << path;
+    WMHandoffCancel();
+    StartDebugFs(argv[0] + std::string("-debugfs"));
+}
+
 auto Main(int argc, char **argv) -> int
 {
     LoggingInit();
@@ -33,36 +164,88 @@ auto Main(int argc, char **argv) -> int
     SigSegvExitZero();
 
     bool isRunning = true;
+    int restoreFd = -1;
+    const char *recordPath = nullptr;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if (arg == "--containers")
+            wmHideStrategy = WMHideStrategy::KContainers;
+        else if (arg == "--iconify")
+            wmHideStrategy = WMHideStrategy::KIconify;
+        else if (arg.starts_with("--restore-fd="))
+        {
+            std::string_view value = arg.substr(std::string_view{"--restore-fd="}.size());
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), restoreFd);
+            if (ec != std::errc{} || end != value.data() + value.size())
+                LOG(QFATAL) << "invalid " << arg;
+        }
+        else if (arg.starts_with("--spawn-cgroup="))
+            spawnOptions.cgroup = argv[i] + std::string_view{"--spawn-cgroup="}.size();
+        else if (arg.starts_with("--record="))
+            recordPath = argv[i] + std::string_view{"--record="}.size();
+        else if (arg.starts_with("--motion-rate="))
+        {
+            std::string_view value = arg.substr(std::string_view{"--motion-rate="}.size());
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), wmMotionRateCap);
+            if (ec != std::errc{} || end != value.data() + value.size())
+                LOG(QFATAL) << "invalid " << arg;
+        }
+        else
+            LOG(QFATAL) << "unknown argument " << arg;
+    }
 
     X11Initialize(true, true);
 
     xcb_grab_server(x11.conn);
 
-    if (xcb_request_check(x11.conn,
-                          xcb_change_window_attributes_checked(
-                              x11.conn, x11.screen->root, XCB_CW_EVENT_MASK,
-                              (uint32_t[]){XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY |
-                                           XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE |
-                                           XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE |
-                                           XCB_EVENT_MASK_FOCUS_CHANGE | XCB_EVENT_MASK_POINTER_MOTION})))
+    // After a restart the server may not have processed the old connection closing yet.
+    for (int attempt = 0;; ++attempt)
     {
-        LOG(QFATAL) << "another wm is already running";
+        xcb_generic_error_t *error = X11_BLOCKING(xcb_request_check(
+            x11.conn, xcb_change_window_attributes_checked(
+                          x11.conn, x11.screen->root, XCB_CW_EVENT_MASK,
+                          (uint32_t[]){XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY |
+                                       XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE |
+                                       XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE |
+                                       XCB_EVENT_MASK_FOCUS_CHANGE | XCB_EVENT_MASK_POINTER_MOTION})));
+        if (!error)
+            break;
+        free(error);
+
+        if (restoreFd < 0 || attempt == 100)
+            LOG(QFATAL) << "another wm is already running";
+        usleep(10 * 1000);
     }
 
+    ReactorInitialize();
+    TimersInitialize();
     DBusInitialize();
-    DebugFsInitialize(argv[0] + std::string("-debugfs"));
+    StartDebugFs(argv[0] + std::string("-debugfs"));
+    X11InitializeRandr();
+    if (recordPath)
+        WMRecorderOpen(recordPath);
     InitializeWM();
+    ScreenSaverInhibitorInit();
 
-    uint16_t modifier = XCB_MOD_MASK_4;
-    std::vector<Keybind> keybinds;
+    static KeybindTable keybinds;
 
     {
         X11KeyResolver keyResolver;
         X11InitializeKeyResolver(keyResolver);
 
-        auto spawnTerminal = [] -> void { Spawn({{"ghostty", nullptr}}); };
-        auto spawnLauncher = [] -> void { Spawn({{"dmenu_run", nullptr}}); };
+        const uint16_t numLockModifier = X11ResolveModifierMask(keyResolver, "NMLK");
+        KeybindTableInitialize(keybinds, numLockModifier);
+
+        // Grabs are exact on modifiers, so every lock state needs its own grab.
+        const uint16_t lockModifiers[] = {0, XCB_MOD_MASK_LOCK, numLockModifier,
+                                          static_cast<uint16_t>(XCB_MOD_MASK_LOCK | numLockModifier)};
+
+        auto spawnTerminal = [] -> void { Spawn({{"ghostty", nullptr}}, spawnOptions); };
+        auto spawnLauncher = [] -> void { Spawn({{"dmenu_run", nullptr}}, spawnOptions); };
         auto nothing = [] -> void {};
+        auto restart = [] -> void { restartRequested = true; };
 
         for (auto [key, mod, handler] : std::initializer_list<std::tuple<KeyPhysical, int, KeybindHandler>>{
                  {KeyPhysical::W, 0, NextLayout},
@@ -75,46 +258,44 @@ auto Main(int argc, char **argv) -> int
                  {KeyPhysical::D, 1, nothing},
                  {KeyPhysical::F, 1, nothing},
                  {KeyPhysical::G, 0, ToggleZoom},
+                 {KeyPhysical::G, 1, ToggleFullscreen},
                  {KeyPhysical::X, 0, CloseActive},
                  {KeyPhysical::V, 0, ToggleFollow},
                  {KeyPhysical::T, 0, spawnTerminal},
                  {KeyPhysical::S, 0, spawnLauncher},
+                 {KeyPhysical::Q, 1, restart},
              })
         {
             const char *xkbName = ConvertKeyPhysicalIntoXkbName(key);
             xcb_keycode_t keycode = X11ResolveKeyCode(keyResolver, xkbName);
 
             mod |= XCB_MOD_MASK_4;
-            keybinds.emplace_back(keycode, mod, handler);
+            KeybindTableAdd(keybinds, keycode, mod, handler);
 
-            xcb_grab_key(x11.conn, false, x11.screen->root, mod, keycode, XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+            for (uint16_t lockMod : lockModifiers)
+            {
+                xcb_grab_key(x11.conn, false, x11.screen->root, mod | lockMod, keycode, XCB_GRAB_MODE_ASYNC,
+                             XCB_GRAB_MODE_ASYNC);
+            }
         }
 
         X11FreeKeyResolver(keyResolver);
     }
 
-    using namespace std::chrono_literals;
-    int tfd = MakeTimerFd(501ms);
-
-    ManageClientsStartup();
-
-    std::vector<pollfd> fds;
-    fds.emplace_back(pollfd{
-        .fd = xcb_get_file_descriptor(x11.conn),
-        .events = POLLIN,
-    });
-    fds.emplace_back(pollfd{
-        .fd = debugfs.fd,
-        .events = POLLIN,
-    });
-
-    if (!tfd)
-        LOG(QFATAL) << "MakeTimerFdMillis";
-    absl::Cleanup tfdCloser = [tfd] -> void { close(tfd); };
-    fds.emplace_back(pollfd{
-        .fd = tfd,
-        .events = POLLIN,
-    });
+    WMDBusInit(isRunning, keybinds);
+
+    if (restoreFd < 0 || !WMHandoffRestore(restoreFd))
+        ManageClientsStartup(QueryExistingWindows());
+    if (restoreFd >= 0)
+    {
+        close(restoreFd);
+        SpawnAdoptChildren();
+    }
+
+    ReactorAdd(
+        xcb_get_file_descriptor(x11.conn), EPOLLIN, ReactorTrigger::KLevel,
+        [](int fd, uint32_t events, void *data) -> void { RunWM(*static_cast<bool *>(data), keybinds); },
+        &isRunning);
 
     DebugFsRegister(
         "quit", &isRunning, //
@@ -124,9 +305,21 @@ auto Main(int argc, char **argv) -> int
             LOG(INFO) << "exit requested";
         });
 
-    xcb_flush(x11.conn);
+    DebugFsRegister(
+        "restart", nullptr, //
+        [](auto &file) -> auto { file.content = "restart\n"; },
+        [](auto &file) -> auto {
+            restartRequested = true;
+            LOG(INFO) << "restart requested";
+        });
+
+    // Client event masks have to be in place before anything can change behind the grab.
+    WMCommandsFlush();
     xcb_ungrab_server(x11.conn);
 
+    // Events read while waiting for startup replies sit in xcb's queue and never make the fd readable.
+    RunWM(isRunning, keybinds);
+
     //
 
 #if 0
@@ -134,17 +327,7 @@ auto Main(int argc, char **argv) -> int
         std::future<void> fut = InitWMBackground();
         while (!IsFutureReady(fut) && isRunning && !xcb_connection_has_error(x11.conn))
         {
-            if (poll(fds.data(), fds.size(), -1) == -1)
-            {
-                continue;
-            }
-
-            if (fds[0].revents & POLLIN)
-            {
-                ProcessWMEvents(isRunning, modifier, keybinds);
-                ProcessWM();
-                xcb_flush(x11.conn);
-            }
+            ReactorWait(-1);
         }
     }
 #endif
@@ -152,39 +335,21 @@ auto Main(int argc, char **argv) -> int
     {
         while (isRunning && !xcb_connection_has_error(x11.conn))
         {
-            if (poll(fds.data(), fds.size(), -1) == -1)
-            {
-                continue;
-            }
+            ReactorWait(-1);
 
-            if (fds[0].revents & POLLIN)
-            {
-                ProcessWMEvents(isRunning, modifier, keybinds);
-                ProcessWM();
-                xcb_flush(x11.conn);
-            }
+            if (dbus.dispatchPending)
+                DBusProcess();
 
-            if (fds[1].revents & POLLIN)
-            {
-                DebugFsProcess();
-            }
+            if (std::exchange(restartRequested, false))
+                Restart(argc, argv);
 
-            if (fds[2].revents & POLLIN)
-            {
-                uint64_t expirations = 0;
-                if (read(tfd, &expirations, sizeof(expirations)) > 0 && expirations > 0)
-                {
-                    wmBackgroundDirty = true;
-                }
-            }
+            RunWMIfQueued(isRunning, keybinds);
 
             if (wmBackgroundDirty)
             {
                 UpdateBackground();
                 wmBackgroundDirty = false;
             }
-
-            DBusProcess();
         }
     }
 
@@ -1,28 +1,46 @@
 #include "nyla/apps/wm/window_manager.h"
 
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <ctime>
 #include <iterator>
 #include <limits>
 #include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "absl/cleanup/cleanup.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/node_hash_map.h"
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/strings/str_join.h"
+#include "nyla/apps/wm/event_record.h"
 #include "nyla/apps/wm/layout.h"
 #include "nyla/apps/wm/palette.h"
-#include "nyla/apps/wm/screen_saver_inhibitor.h"
+#include "nyla/apps/wm/wm_commands.h"
 #include "nyla/commons/containers/map.h"
+#include "nyla/commons/containers/set.h"
+#include "nyla/commons/os/clock.h"
+#include "nyla/commons/os/timerfd.h"
+#include "nyla/commons/stats/latency_histogram.h"
 #include "nyla/debugfs/debugfs.h"
 #include "nyla/platform/x11/platform_x11.h"
+#include "nyla/platform/x11/platform_x11_audit.h"
 #include "nyla/platform/x11/platform_x11_error.h"
 #include "nyla/platform/x11/platform_x11_wm_hints.h"
 #include "xcb/xcb.h"
+#include "xcb/randr.h"
 #include "xcb/xinput.h"
 #include "xcb/xproto.h"
 
@@ -32,21 +50,72 @@ namespace nyla
 using namespace platform_x11_internal;
 
 static auto DumpClients() -> std::string;
+static auto DumpLayoutStats() -> std::string;
+static auto DumpEventStats() -> std::string;
+static auto DumpMotionStats() -> std::string;
+static auto DumpCommandStats() -> std::string;
+static auto DumpPropertyStats() -> std::string;
+static auto DumpEventLatency() -> std::string;
+static auto DumpPhaseLatency() -> std::string;
 
 struct WindowStack
 {
     LayoutType layoutType;
     bool zoom;
+    bool layoutDirty;
 
     std::vector<xcb_window_t> windows;
     xcb_window_t activeWindow;
+
+    xcb_window_t container;
+    LayoutMemo layoutMemo;
+};
+
+static constexpr uint32_t kNoSlot = std::numeric_limits<uint32_t>::max();
+static constexpr uint32_t kTrackedPropertyCount = 6;
+static_assert(kTrackedPropertyCount <= 8, "Client property bitmasks are 8 bits wide");
+
+struct Client;
+
+// Values are fetched up to maxLongs 32-bit units, longer ones are marked truncated and only fetched in full, up to
+// kFullPropertyLongs, when something reads them. Lazy properties are not fetched on change either, only when read.
+struct TrackedProperty
+{
+    xcb_atom_t atom;
+    const char *name;
+    void (*handler)(xcb_window_t, Client &, xcb_get_property_reply_t *);
+    uint32_t maxLongs;
+    bool lazy;
+};
+
+static constexpr uint32_t kFullPropertyLongs = 16 * 1024;
+
+static constexpr uint32_t kClientEventMask =
+    XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_FOCUS_CHANGE | XCB_EVENT_MASK_ENTER_WINDOW;
+
+struct PropertyFetch
+{
+    uint32_t sequence;
+    bool pending;
+    bool initial;
+    bool full;
+};
+
+struct PropertyReply
+{
+    xcb_window_t window;
+    uint32_t propertyIdx;
+    xcb_get_property_reply_t *reply;
 };
 
 struct Client
 {
+    xcb_window_t window;
+    uint32_t stackIdx;
+
     Rect rect;
     uint32_t borderWidth;
-    std::string name;
+    const std::string *name;
 
     bool wmHintsInput;
     bool wmTakeFocus;
@@ -59,9 +128,24 @@ struct Client
     bool wantsConfigureNotify;
 
     xcb_window_t transientFor;
-    std::vector<xcb_window_t> subwindows;
-
-    Map<xcb_atom_t, xcb_get_property_cookie_t> propertyCookies;
+    uint32_t firstSubwindow;
+    uint32_t nextSibling;
+    uint32_t subwindowCount;
+
+    xcb_window_t container;
+    uint32_t ignoreUnmaps;
+    bool iconic;
+    bool fullscreen;
+    // _NET_WM_STATE atoms the WM does not manage, written back untouched.
+    std::vector<xcb_atom_t> otherNetWmStates;
+
+    std::array<PropertyFetch, kTrackedPropertyCount> propertyFetches;
+    uint32_t pendingFetches;
+    uint32_t initialFetches;
+    uint8_t staleProperties;
+    uint8_t truncatedProperties;
+
+    uint64_t manageStartMicros;
 };
 
 template <typename Sink> void AbslStringify(Sink &sink, const Client &c)
@@ -71,28 +155,284 @@ template <typename Sink> void AbslStringify(Sink &sink, const Client &c)
 
 static uint32_t wmBarHeight = 20;
 bool wmBackgroundDirty;
+WMHideStrategy wmHideStrategy = WMHideStrategy::KOffscreen;
 
-static bool wmLayoutDirty;
 static bool wmFollow;
 static bool wmBorderDirty;
 
-static Map<xcb_window_t, Client> wmClients;
+static std::vector<Client> wmClients;
+static std::vector<uint32_t> wmFreeClientSlots;
+static Map<xcb_window_t, uint32_t> wmClientSlotIndex;
+static absl::node_hash_map<std::string, uint32_t> wmInternedNames;
 static std::vector<xcb_window_t> wmPendingClients;
 
-static Map<xcb_atom_t, void (*)(xcb_window_t, Client &, xcb_get_property_reply_t *)> wmPropertyChangeHandlers;
+static std::vector<xcb_window_t> wmClientsAwaitingReplies;
+static std::vector<PropertyReply> wmCompletedReplies;
+static std::vector<xcb_window_t> wmConfigureNotifyQueue;
+
+static std::array<TrackedProperty, kTrackedPropertyCount> wmTrackedProperties;
+
+// Output i owns the kStacksPerOutput stacks starting at i * kStacksPerOutput. Slots of disconnected outputs are kept, a
+// monitor that comes back under the same name gets its slot and stacks again.
+struct Output
+{
+    xcb_atom_t name;
+    Rect rect;
+    uint32_t activeStack;
+    bool connected;
+};
+
+static constexpr uint32_t kStacksPerOutput = 9;
 
 static std::vector<WindowStack> wmStacks;
-static uint64_t wmActiveStackIdx;
+static std::vector<Output> wmOutputs;
+static uint32_t wmActiveOutputIdx;
+static uint32_t wmPrimaryOutputIdx;
+
+static struct
+{
+    uint64_t configuresSent;
+    uint64_t configuresAvoided;
+    uint64_t layoutsComputed;
+    uint64_t layoutsMemoized;
+} wmLayoutStats;
+
+static struct
+{
+    uint64_t received;
+    uint64_t dispatched;
+} wmEventStats;
+
+// Indexed like wmTrackedProperties. Notifies are counted before coalescing, so a client that changed a property n times
+// sees notified grow by n once the WM has taken all of them.
+struct PropertyStats
+{
+    uint64_t notified;
+    uint64_t coalesced;
+    uint64_t deferred;
+    uint64_t fetched;
+    uint64_t handled;
+};
+
+static std::array<PropertyStats, kTrackedPropertyCount> wmPropertyStats;
+
+// All latencies are in microseconds.
+static Map<uint8_t, LatencyHistogram> wmEventLatency;
+
+static struct
+{
+    LatencyHistogram mapToManaged;
+    LatencyHistogram replies;
+    LatencyHistogram manage;
+    LatencyHistogram layout;
+    LatencyHistogram computeLayout;
+    LatencyHistogram hiddenStacks;
+    LatencyHistogram configureNotify;
+    LatencyHistogram total;
+} wmPhaseLatency;
+
+static Map<xcb_window_t, xcb_window_t> wmWindowParents;
+
+void (*wmActiveStateObserver)(const WMActiveState &state);
+
+uint32_t wmMotionRateCap = 125;
+
+// Raw motion is deselected after this long without movement, the next EnterNotify selects it again.
+static constexpr uint64_t kMotionIdleMillis = 2000;
+
+static bool wmRawMotionSelected = true;
+static uint64_t wmLastMotionMillis;
+static uint64_t wmMotionIdleTimer;
+
+static struct
+{
+    uint64_t received;
+    uint64_t absorbed;
+    uint64_t deselected;
+    uint64_t reselected;
+} wmMotionStats;
+
+// While a fullscreen client is active everything but key handling and that client is suspended: raw motion is
+// deselected, crossings are ignored and property changes of other clients are only marked stale.
+static struct
+{
+    xcb_window_t window;
+    uint32_t stackIdx;
+    bool restoreZoom;
+} wmGameMode;
 
 static xcb_timestamp_t lastRawmotionTs = 0;
+static xcb_timestamp_t lastSampledRawmotionTs = 0;
 static xcb_window_t lastEnteredWindow = 0;
 
 //
 
+static void RequestPropertyForReader(Client &client, xcb_atom_t property);
+
+static auto ActiveStackIdx() -> uint32_t
+{
+    return wmOutputs.at(wmActiveOutputIdx).activeStack;
+}
+
 static auto GetActiveStack() -> WindowStack &
 {
-    CHECK_LT(wmActiveStackIdx & 0xFF, wmStacks.size());
-    return wmStacks.at(wmActiveStackIdx & 0xFF);
+    return wmStacks.at(ActiveStackIdx());
+}
+
+static auto IsStackVisible(uint32_t stackIdx) -> bool
+{
+    const Output &output = wmOutputs.at(stackIdx / kStacksPerOutput);
+    return output.connected && output.activeStack == stackIdx;
+}
+
+// Client rects are relative to the stack container when there is one, containers cover their output.
+static auto OutputLayoutRect(const Output &output) -> Rect
+{
+    if (wmHideStrategy == WMHideStrategy::KContainers)
+        return Rect(output.rect.Width(), output.rect.Height());
+    return output.rect;
+}
+
+static auto FindOutputAt(int32_t x, int32_t y) -> uint32_t
+{
+    for (uint32_t outputIdx = 0; outputIdx < wmOutputs.size(); ++outputIdx)
+    {
+        const Output &output = wmOutputs[outputIdx];
+        if (output.connected && x >= output.rect.X() && y >= output.rect.Y() &&
+            x < output.rect.X() + static_cast<int32_t>(output.rect.Width()) &&
+            y < output.rect.Y() + static_cast<int32_t>(output.rect.Height()))
+            return outputIdx;
+    }
+    return kNoSlot;
+}
+
+static auto FindClient(xcb_window_t window) -> Client *
+{
+    auto it = wmClientSlotIndex.find(window);
+    if (it == wmClientSlotIndex.end())
+        return nullptr;
+    return &wmClients[it->second];
+}
+
+// Subwindows are on the stack of their parent.
+static auto ClientStackIdx(const Client &client) -> uint32_t
+{
+    if (const Client *parent = client.transientFor ? FindClient(client.transientFor) : nullptr)
+        return parent->stackIdx;
+    return client.stackIdx;
+}
+
+static auto GetClient(xcb_window_t window) -> Client &
+{
+    Client *client = FindClient(window);
+    CHECK(client);
+    return *client;
+}
+
+static auto ClientSlot(const Client &client) -> uint32_t
+{
+    return &client - wmClients.data();
+}
+
+static auto InternName(std::string_view name) -> const std::string *
+{
+    auto [it, _] = wmInternedNames.try_emplace(std::string{name}, 0);
+    ++it->second;
+    return &it->first;
+}
+
+static void ReleaseName(const std::string *name)
+{
+    if (!name)
+        return;
+
+    auto it = wmInternedNames.find(*name);
+    CHECK(it != wmInternedNames.end());
+    if (!--it->second)
+        wmInternedNames.erase(it);
+}
+
+static auto ClientName(const Client &client) -> std::string_view
+{
+    return client.name ? std::string_view{*client.name} : std::string_view{};
+}
+
+// Slots are reused, so references into wmClients are only valid until the next AcquireClient.
+static auto AcquireClient(xcb_window_t window) -> Client &
+{
+    uint32_t slot;
+    if (wmFreeClientSlots.empty())
+    {
+        slot = wmClients.size();
+        wmClients.emplace_back();
+    }
+    else
+    {
+        slot = wmFreeClientSlots.back();
+        wmFreeClientSlots.pop_back();
+    }
+    wmClientSlotIndex.emplace(window, slot);
+
+    Client &client = wmClients[slot];
+    client = Client{.window = window, .stackIdx = kNoSlot, .firstSubwindow = kNoSlot, .nextSibling = kNoSlot};
+    return client;
+}
+
+static void ReleaseClient(Client &client)
+{
+    ReleaseName(client.name);
+    wmClientSlotIndex.erase(client.window);
+    wmFreeClientSlots.emplace_back(ClientSlot(client));
+    client = Client{};
+}
+
+static void AddSubwindow(Client &parent, Client &subwindow)
+{
+    uint32_t *link = &parent.firstSubwindow;
+    while (*link != kNoSlot)
+        link = &wmClients[*link].nextSibling;
+
+    *link = ClientSlot(subwindow);
+    subwindow.nextSibling = kNoSlot;
+    ++parent.subwindowCount;
+}
+
+static void RemoveSubwindow(Client &parent, Client &subwindow)
+{
+    const uint32_t slot = ClientSlot(subwindow);
+    for (uint32_t *link = &parent.firstSubwindow; *link != kNoSlot; link = &wmClients[*link].nextSibling)
+    {
+        if (*link != slot)
+            continue;
+
+        *link = subwindow.nextSibling;
+        subwindow.nextSibling = kNoSlot;
+        --parent.subwindowCount;
+        return;
+    }
+}
+
+static void ForEachSubwindow(const Client &client, auto fn)
+{
+    for (uint32_t slot = client.firstSubwindow; slot != kNoSlot; slot = wmClients[slot].nextSibling)
+        fn(wmClients[slot]);
+}
+
+static auto FindStack(const Client &client) -> WindowStack *
+{
+    if (client.stackIdx == kNoSlot)
+        return nullptr;
+    return &wmStacks.at(client.stackIdx);
+}
+
+static auto FindTrackedProperty(xcb_atom_t property) -> uint32_t
+{
+    for (uint32_t i = 0; i < kTrackedPropertyCount; ++i)
+    {
+        if (wmTrackedProperties[i].atom == property)
+            return i;
+    }
+    return kNoSlot;
 }
 
 static void HandleWmHints(xcb_window_t clientWindow, Client &client, xcb_get_property_reply_t *reply)
@@ -136,8 +476,10 @@ static void HandleWmName(xcb_window_t clientWindow, Client &client, xcb_get_prop
         return;
     }
 
-    client.name = {static_cast<char *>(xcb_get_property_value(reply)),
-                   static_cast<size_t>(xcb_get_property_value_length(reply))};
+    const std::string *name = InternName({static_cast<char *>(xcb_get_property_value(reply)),
+                                          static_cast<size_t>(xcb_get_property_value_length(reply))});
+    ReleaseName(client.name);
+    client.name = name;
     // LOG(INFO) << client_window << " name=" << client.name;
 }
 
@@ -185,22 +527,138 @@ static void HandleWmTransientFor(xcb_window_t clientWindow, Client &client, xcb_
     client.transientFor = *reinterpret_cast<xcb_window_t *>(xcb_get_property_value(reply));
 }
 
-void InitializeWM()
+static void HandleNetWmState(xcb_window_t clientWindow, Client &client, xcb_get_property_reply_t *reply)
+{
+    if (!reply || reply->type != XCB_ATOM_ATOM)
+        return;
+
+    auto states = std::span{
+        static_cast<xcb_atom_t *>(xcb_get_property_value(reply)),
+        xcb_get_property_value_length(reply) / sizeof(xcb_atom_t),
+    };
+    client.fullscreen = std::ranges::find(states, x11.atoms.net_wm_state_fullscreen) != states.end();
+
+    client.otherNetWmStates.clear();
+    for (xcb_atom_t state : states)
+    {
+        if (state != x11.atoms.net_wm_state_fullscreen && state != x11.atoms.net_wm_state_hidden)
+            client.otherNetWmStates.emplace_back(state);
+    }
+}
+
+// Captures keep the ids so that wm_replay creates its windows under the same ones.
+static auto GenerateId() -> xcb_window_t
+{
+    const xcb_window_t id = wmServerSource.generateId();
+    if (wmRecorder.file)
+        WMRecordGeneratedId(id);
+    return id;
+}
+
+static auto CreateContainer(const Rect &rect) -> xcb_window_t
+{
+    const xcb_window_t container = GenerateId();
+    WMCreateWindow(container, x11.screen->root, XCB_WINDOW_CLASS_INPUT_OUTPUT, rect.X(), rect.Y(), rect.Width(),
+                   rect.Height(), XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY);
+    return container;
+}
+
+static void UpdateOutputs();
+
+// EWMH clients only send _NET_WM_STATE requests to a WM that advertises them through a check window.
+static void AdvertiseEwmhSupport()
 {
-    wmStacks.resize(9);
+    const xcb_window_t checkWindow = GenerateId();
+    WMCreateWindow(checkWindow, x11.screen->root, XCB_WINDOW_CLASS_INPUT_ONLY, -1, -1, 1, 1, 0);
+
+    WMChangeProperty(checkWindow, x11.atoms.net_supporting_wm_check, XCB_ATOM_WINDOW, {&checkWindow, 1});
+    WMChangeProperty(x11.screen->root, x11.atoms.net_supporting_wm_check, XCB_ATOM_WINDOW, {&checkWindow, 1});
+
+    const uint32_t supported[] = {
+        x11.atoms.net_supported,
+        x11.atoms.net_supporting_wm_check,
+        x11.atoms.net_wm_state,
+        x11.atoms.net_wm_state_fullscreen,
+        x11.atoms.net_wm_state_hidden,
+    };
+    WMChangeProperty(x11.screen->root, x11.atoms.net_supported, XCB_ATOM_ATOM, supported);
+}
 
-    wmPropertyChangeHandlers.try_emplace(XCB_ATOM_WM_HINTS, HandleWmHints);
-    wmPropertyChangeHandlers.try_emplace(XCB_ATOM_WM_NORMAL_HINTS, HandleWmNormalHints);
-    wmPropertyChangeHandlers.try_emplace(XCB_ATOM_WM_NAME, HandleWmName);
-    wmPropertyChangeHandlers.try_emplace(x11.atoms.wm_protocols, HandleWmProtocols);
-    wmPropertyChangeHandlers.try_emplace(XCB_ATOM_WM_TRANSIENT_FOR, HandleWmTransientFor);
+void InitializeWM()
+{
+    UpdateOutputs();
+    wmActiveOutputIdx = wmPrimaryOutputIdx;
+    AdvertiseEwmhSupport();
+
+    // Left behind if the previous WM died in game mode, it starts out of it.
+    WMDeleteProperty(x11.screen->root, x11.atoms.nyla_wm_game_mode);
+
+    wmTrackedProperties = {{
+        {XCB_ATOM_WM_HINTS, "WM_HINTS", HandleWmHints, sizeof(WmHints) / 4, false},
+        {XCB_ATOM_WM_NORMAL_HINTS, "WM_NORMAL_HINTS", HandleWmNormalHints, 18, false},
+        {XCB_ATOM_WM_NAME, "WM_NAME", HandleWmName, 64, true},
+        {x11.atoms.wm_protocols, "WM_PROTOCOLS", HandleWmProtocols, 32, false},
+        {XCB_ATOM_WM_TRANSIENT_FOR, "WM_TRANSIENT_FOR", HandleWmTransientFor, 1, false},
+        {x11.atoms.net_wm_state, "_NET_WM_STATE", HandleNetWmState, 8, false},
+    }};
 
     DebugFsRegister(
         "windows", nullptr,                                       //
         [](auto &file) -> auto { file.content = DumpClients(); }, //
         nullptr);
 
-    ScreenSaverInhibitorInit();
+    DebugFsRegister(
+        "layout_stats", nullptr,                                      //
+        [](auto &file) -> auto { file.content = DumpLayoutStats(); }, //
+        nullptr);
+
+    DebugFsRegister(
+        "event_stats", nullptr,                                      //
+        [](auto &file) -> auto { file.content = DumpEventStats(); }, //
+        nullptr);
+
+    DebugFsRegister(
+        "motion_stats", nullptr,                                      //
+        [](auto &file) -> auto { file.content = DumpMotionStats(); }, //
+        nullptr);
+
+    DebugFsRegister(
+        "command_stats", nullptr,                                      //
+        [](auto &file) -> auto { file.content = DumpCommandStats(); }, //
+        nullptr);
+
+    DebugFsRegister(
+        "property_stats", nullptr,                                      //
+        [](auto &file) -> auto { file.content = DumpPropertyStats(); }, //
+        nullptr);
+
+    DebugFsRegister(
+        "event_latency", nullptr,                                      //
+        [](auto &file) -> auto { file.content = DumpEventLatency(); }, //
+        nullptr,                                                       //
+        [](auto &file, std::string_view) -> auto { wmEventLatency.clear(); });
+
+    DebugFsRegister(
+        "phase_latency", nullptr,                                      //
+        [](auto &file) -> auto { file.content = DumpPhaseLatency(); }, //
+        nullptr,                                                       //
+        [](auto &file, std::string_view) -> auto { wmPhaseLatency = {}; });
+
+#if defined(NYLA_X11_AUDIT_ROUND_TRIPS)
+    DebugFsRegister(
+        "round_trips", nullptr,                                         //
+        [](auto &file) -> auto { file.content = X11DumpRoundTrips(); }, //
+        nullptr,                                                        //
+        [](auto &file, std::string_view) -> auto { X11ResetRoundTrips(); });
+#endif
+}
+
+// Returns the end time so consecutive phases can chain their measurements.
+static auto RecordLatency(LatencyHistogram &histogram, uint64_t startMicros) -> uint64_t
+{
+    const uint64_t now = GetMonotonicTimeMicros();
+    LatencyHistogramRecord(histogram, now - startMicros);
+    return now;
 }
 
 static void ClearZoom(WindowStack &stack)
@@ -209,14 +667,14 @@ static void ClearZoom(WindowStack &stack)
         return;
 
     stack.zoom = false;
-    wmLayoutDirty = true;
+    stack.layoutDirty = true;
 }
 
-static void ApplyBorder(xcb_connection_t *conn, xcb_window_t window, Color color)
+static void ApplyBorder(xcb_window_t window, Color color)
 {
     if (!window)
         return;
-    xcb_change_window_attributes(conn, window, XCB_CW_BORDER_PIXEL, &color);
+    WMChangeWindowAttribute(window, XCB_CW_BORDER_PIXEL, static_cast<uint32_t>(color));
 }
 
 static void Activate(const WindowStack &stack, xcb_timestamp_t time)
@@ -226,26 +684,24 @@ static void Activate(const WindowStack &stack, xcb_timestamp_t time)
         goto revert_to_root;
     }
 
-    if (auto it = wmClients.find(stack.activeWindow); it != wmClients.end())
+    if (const Client *client = FindClient(stack.activeWindow))
     {
         wmBorderDirty = true;
 
-        const auto &client = it->second;
+        xcb_window_t immediateFocus = client->wmHintsInput ? stack.activeWindow : x11.screen->root;
 
-        xcb_window_t immediateFocus = client.wmHintsInput ? stack.activeWindow : x11.screen->root;
+        WMSetInputFocus(immediateFocus, time);
 
-        xcb_set_input_focus(x11.conn, XCB_INPUT_FOCUS_NONE, immediateFocus, time);
-
-        if (client.wmTakeFocus)
+        if (client->wmTakeFocus)
         {
-            X11SendWmTakeFocus(stack.activeWindow, time);
+            WMSendTakeFocus(stack.activeWindow, time);
         }
 
         return;
     }
 
 revert_to_root:
-    xcb_set_input_focus(x11.conn, XCB_INPUT_FOCUS_NONE, x11.screen->root, time);
+    WMSetInputFocus(x11.screen->root, time);
     lastEnteredWindow = 0;
 }
 
@@ -253,30 +709,42 @@ static void Activate(WindowStack &stack, xcb_window_t clientWindow, xcb_timestam
 {
     if (stack.activeWindow != clientWindow)
     {
-        ApplyBorder(x11.conn, stack.activeWindow, Color::KNone);
+        ApplyBorder(stack.activeWindow, Color::KNone);
         stack.activeWindow = clientWindow;
         wmBackgroundDirty = true;
+
+        if (Client *client = FindClient(clientWindow))
+            RequestPropertyForReader(*client, XCB_ATOM_WM_NAME);
     }
 
     Activate(stack, time);
 }
 
-static void MaybeActivateUnderPointer(WindowStack &stack, xcb_timestamp_t ts)
+static void SetActiveOutput(uint32_t outputIdx, xcb_timestamp_t time)
 {
-    if (stack.zoom)
+    if (outputIdx == kNoSlot || outputIdx == wmActiveOutputIdx)
         return;
+
+    ApplyBorder(GetActiveStack().activeWindow, Color::KNone);
+    wmActiveOutputIdx = outputIdx;
+    wmFollow = false;
+    wmBorderDirty = true;
+    wmBackgroundDirty = true;
+
+    Activate(GetActiveStack(), time);
+}
+
+static void MaybeActivateUnderPointer(xcb_timestamp_t ts)
+{
     if (wmFollow)
         return;
 
-    if (!lastEnteredWindow)
+    const xcb_window_t enteredWindow = lastEnteredWindow;
+    if (!enteredWindow)
     {
         return;
     }
-    if (lastEnteredWindow == x11.screen->root)
-    {
-        return;
-    }
-    if (lastEnteredWindow == stack.activeWindow)
+    if (enteredWindow == x11.screen->root)
     {
         return;
     }
@@ -286,69 +754,153 @@ static void MaybeActivateUnderPointer(WindowStack &stack, xcb_timestamp_t ts)
     if (ts - lastRawmotionTs > 3)
         return;
 
-    if (wmClients.find(lastEnteredWindow) != wmClients.end())
+    const Client *client = FindClient(enteredWindow);
+    if (!client)
+        return;
+
+    const uint32_t stackIdx = ClientStackIdx(*client);
+    if (stackIdx == kNoSlot || !IsStackVisible(stackIdx))
+        return;
+
+    // Entering a window on another output moves the active output along.
+    SetActiveOutput(stackIdx / kStacksPerOutput, ts);
+
+    WindowStack &stack = wmStacks.at(stackIdx);
+    if (stack.zoom)
+        return;
+    if (enteredWindow == stack.activeWindow)
+    {
+        return;
+    }
+
+    Activate(stack, enteredWindow, ts);
+}
+
+static auto ResolveClient(xcb_window_t window) -> xcb_window_t
+{
+    while (window && window != x11.screen->root)
     {
-        Activate(stack, lastEnteredWindow, ts);
+        if (wmClientSlotIndex.contains(window))
+            return window;
+
+        auto it = wmWindowParents.find(window);
+        if (it == wmWindowParents.end())
+            return 0;
+        window = it->second;
     }
+    return 0;
 }
 
-static void CheckFocusTheft()
+static void ArmMotionIdleTimer(uint64_t delayMillis)
 {
-    auto reply = xcb_get_input_focus_reply(x11.conn, xcb_get_input_focus(x11.conn), nullptr);
-    xcb_window_t focusedWindow = reply->focus;
-    free(reply);
+    wmMotionIdleTimer = TimerAdd(
+        delayMillis, 0, delayMillis / 4,
+        [](void *data) -> void {
+            wmMotionIdleTimer = 0;
 
-    const WindowStack &stack = GetActiveStack();
-    if (stack.activeWindow == focusedWindow)
+            const uint64_t idleMillis = GetMonotonicTimeMillis() - wmLastMotionMillis;
+            if (idleMillis < kMotionIdleMillis)
+            {
+                ArmMotionIdleTimer(kMotionIdleMillis - idleMillis);
+                return;
+            }
+
+            WMSelectRawMotion(false);
+            WMCommandsFlush();
+            wmRawMotionSelected = false;
+            ++wmMotionStats.deselected;
+        },
+        nullptr);
+}
+
+static void HandleRawMotion(const xcb_input_raw_motion_event_t &rawmotion)
+{
+    // Events sent before the deselect reached the server.
+    if (wmGameMode.window)
         return;
 
-    if (focusedWindow == x11.screen->root)
+    wmLastMotionMillis = GetMonotonicTimeMillis();
+    if (!wmMotionIdleTimer)
+        ArmMotionIdleTimer(kMotionIdleMillis);
+
+    // Always tracked, EnterNotify relies on it to tell pointer movement from windows moving under the pointer.
+    lastRawmotionTs = std::max(lastRawmotionTs, rawmotion.time);
+
+    if (wmMotionRateCap && lastRawmotionTs - lastSampledRawmotionTs < 1000 / wmMotionRateCap)
+    {
+        ++wmMotionStats.absorbed;
         return;
-    if (!focusedWindow)
+    }
+    lastSampledRawmotionTs = lastRawmotionTs;
+
+    MaybeActivateUnderPointer(lastRawmotionTs);
+}
+
+static void HandleEnterNotify(const xcb_enter_notify_event_t &enternotify)
+{
+    lastEnteredWindow = enternotify.event;
+    if (wmGameMode.window)
         return;
 
-    if (!wmClients.contains(focusedWindow))
+    if (!wmRawMotionSelected)
     {
-        for (;;)
-        {
-            xcb_query_tree_reply_t *reply =
-                xcb_query_tree_reply(x11.conn, xcb_query_tree(x11.conn, focusedWindow), nullptr);
+        // Without recent raw motion nothing is activated here, the motion that follows does it.
+        WMSelectRawMotion(true);
+        wmRawMotionSelected = true;
+        ++wmMotionStats.reselected;
+        return;
+    }
 
-            if (!reply)
-            {
-                Activate(stack, XCB_CURRENT_TIME);
-                return;
-            }
+    MaybeActivateUnderPointer(enternotify.time);
+}
+
+// Pointer motion over the bare root window, as on an output without windows, picks the output under the pointer.
+static void HandleMotionNotify(const xcb_motion_notify_event_t &motionnotify)
+{
+    if (wmGameMode.window || motionnotify.event != x11.screen->root || motionnotify.child != XCB_NONE)
+        return;
 
-            xcb_window_t parent = reply->parent;
-            free(reply);
+    SetActiveOutput(FindOutputAt(motionnotify.root_x, motionnotify.root_y), motionnotify.time);
+}
 
-            if (!parent || parent == x11.screen->root)
-                break;
-            focusedWindow = parent;
-        }
+static void CheckFocusTheft(const xcb_focus_in_event_t &focusin)
+{
+    switch (focusin.detail)
+    {
+    case XCB_NOTIFY_DETAIL_POINTER:
+    case XCB_NOTIFY_DETAIL_POINTER_ROOT:
+    case XCB_NOTIFY_DETAIL_NONE:
+        return;
     }
 
+    // Focus is either on the event window itself or, for the virtual details, on one of its descendants.
+    xcb_window_t focusedWindow = focusin.event;
+    if (!focusedWindow || focusedWindow == x11.screen->root)
+        return;
+
+    const WindowStack &stack = GetActiveStack();
+    if (xcb_window_t clientWindow = ResolveClient(focusedWindow))
+        focusedWindow = clientWindow;
+
     if (stack.activeWindow == focusedWindow)
         return;
 
-    auto it = wmClients.find(focusedWindow);
-    if (it == wmClients.end())
+    const Client *client = FindClient(focusedWindow);
+    if (!client)
     {
         Activate(stack, XCB_CURRENT_TIME);
         return;
     }
 
-    const auto &[_, client] = *it;
-    if (client.transientFor)
+    if (client->transientFor)
     {
-        if (client.transientFor == stack.activeWindow)
+        if (client->transientFor == stack.activeWindow)
         {
             return;
         }
 
-        if (auto it = wmClients.find(stack.activeWindow);
-            it != wmClients.end() && client.transientFor == it->second.transientFor)
+        if (const Client *activeClient = FindClient(stack.activeWindow);
+            activeClient && client->transientFor == activeClient->transientFor)
         {
             return;
         }
@@ -357,198 +909,307 @@ static void CheckFocusTheft()
     Activate(stack, XCB_CURRENT_TIME);
 }
 
-static void FetchClientProperty(xcb_window_t clientWindow, Client &client, xcb_atom_t property)
+static void FetchClientProperty(xcb_window_t clientWindow, Client &client, xcb_atom_t property, bool initial = false,
+                                bool full = false)
 {
-    if (!wmPropertyChangeHandlers.contains(property))
+    const uint32_t propertyIdx = FindTrackedProperty(property);
+    if (propertyIdx == kNoSlot)
         return;
 
-    auto cookie = xcb_get_property_unchecked(x11.conn, false, clientWindow, property, XCB_ATOM_ANY, 0,
-                                             std::numeric_limits<uint32_t>::max());
+    const uint32_t longLength = full ? kFullPropertyLongs : wmTrackedProperties[propertyIdx].maxLongs;
+    client.staleProperties &= ~(1 << propertyIdx);
 
-    auto it = client.propertyCookies.find(property);
-    if (it == client.propertyCookies.end())
+    const uint32_t sequence = wmServerSource.requestProperty(clientWindow, property, longLength);
+    ++wmPropertyStats[propertyIdx].fetched;
+
+    if (!client.pendingFetches)
+        wmClientsAwaitingReplies.emplace_back(clientWindow);
+
+    PropertyFetch &fetch = client.propertyFetches[propertyIdx];
+    if (fetch.pending)
+    {
+        // The newer request observes the latest value, the older reply is stale.
+        wmServerSource.discardProperty(fetch.sequence);
+    }
+    else
     {
-        client.propertyCookies.try_emplace(property, cookie);
+        fetch.pending = true;
+        fetch.initial = initial;
+        ++client.pendingFetches;
+        if (initial)
+            ++client.initialFetches;
     }
+    fetch.full = full;
+    fetch.sequence = sequence;
 }
 
-void ManageClient(xcb_window_t clientWindow)
+// Brings a lazy or truncated property up to date for a reader, the current value stays in place until the reply is
+// dispatched.
+static void RequestPropertyForReader(Client &client, xcb_atom_t property)
 {
-    if (auto [it, inserted] = wmClients.try_emplace(clientWindow, Client{}); inserted)
-    {
-        xcb_change_window_attributes(
-            x11.conn, clientWindow, XCB_CW_EVENT_MASK,
-            (uint32_t[]){
-                XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_FOCUS_CHANGE | XCB_EVENT_MASK_ENTER_WINDOW,
-            });
+    const uint32_t propertyIdx = FindTrackedProperty(property);
+    if (propertyIdx == kNoSlot || client.propertyFetches[propertyIdx].pending)
+        return;
 
-        for (auto &[property, _] : wmPropertyChangeHandlers)
-        {
-            FetchClientProperty(clientWindow, it->second, property);
-        }
+    if (client.staleProperties & (1 << propertyIdx))
+        FetchClientProperty(client.window, client, property);
+    else if (client.truncatedProperties & (1 << propertyIdx))
+        FetchClientProperty(client.window, client, property, false, true);
+}
 
-        wmPendingClients.emplace_back(clientWindow);
-    }
+static void RequestConfigureNotify(xcb_window_t clientWindow, Client &client)
+{
+    if (client.wantsConfigureNotify)
+        return;
+
+    client.wantsConfigureNotify = true;
+    wmConfigureNotifyQueue.emplace_back(clientWindow);
 }
 
-void ManageClientsStartup()
+void ManageClient(xcb_window_t clientWindow)
 {
-    xcb_query_tree_reply_t *treeReply =
-        xcb_query_tree_reply(x11.conn, xcb_query_tree(x11.conn, x11.screen->root), nullptr);
-    if (!treeReply)
+    if (wmClientSlotIndex.contains(clientWindow))
         return;
 
-    std::span<xcb_window_t> children = {xcb_query_tree_children(treeReply),
-                                        static_cast<size_t>(xcb_query_tree_children_length(treeReply))};
+    Client &client = AcquireClient(clientWindow);
 
-    for (xcb_window_t clientWindow : children)
-    {
-        xcb_get_window_attributes_reply_t *attrReply =
-            xcb_get_window_attributes_reply(x11.conn, xcb_get_window_attributes(x11.conn, clientWindow), nullptr);
-        if (!attrReply)
-            continue;
-        absl::Cleanup attrReplyFreer = [attrReply] -> void { free(attrReply); };
+    // The fetches below bypass the command queue, the event mask has to reach the server ahead of them or a property
+    // change in between is never seen.
+    wmServerSource.selectEvents(clientWindow, kClientEventMask);
 
-        if (attrReply->override_redirect)
-            continue;
-        if (attrReply->map_state == XCB_MAP_STATE_UNMAPPED)
-            continue;
+    // Lets the server restore reparented and iconified clients if the WM goes away.
+    if (wmHideStrategy != WMHideStrategy::KOffscreen)
+        WMChangeSaveSet(clientWindow, XCB_SET_MODE_INSERT);
 
-        ManageClient(clientWindow);
+    for (uint32_t propertyIdx = 0; propertyIdx < kTrackedPropertyCount; ++propertyIdx)
+    {
+        const TrackedProperty &tracked = wmTrackedProperties[propertyIdx];
+        if (tracked.lazy)
+            client.staleProperties |= 1 << propertyIdx;
+        else
+            FetchClientProperty(clientWindow, client, tracked.atom, true);
     }
 
-    free(treeReply);
+    client.manageStartMicros = GetMonotonicTimeMicros();
+    wmPendingClients.emplace_back(clientWindow);
 }
 
-void UnmanageClient(xcb_window_t window)
+void ManageClientsStartup(std::span<const WMExistingWindow> windows)
 {
-    auto it = wmClients.find(window);
-    if (it == wmClients.end())
-        return;
-
-    auto &client = it->second;
+    const uint64_t adoptStart = GetMonotonicTimeMicros();
 
-    for (auto &[_, cookie] : client.propertyCookies)
+    std::vector<xcb_window_t> adopted;
+    for (const WMExistingWindow &existing : windows)
     {
-        xcb_discard_reply(x11.conn, cookie.sequence);
-    }
+        wmWindowParents.insert_or_assign(existing.window, x11.screen->root);
 
-    if (client.transientFor)
-    {
-        CHECK(client.subwindows.empty());
-        auto &subwindows = wmClients.at(client.transientFor).subwindows;
-        auto it = std::ranges::find(subwindows, window);
-        CHECK(it != subwindows.end());
-        subwindows.erase(it);
+        if (existing.overrideRedirect || !existing.mapped)
+            continue;
+
+        ManageClient(existing.window);
+        adopted.emplace_back(existing.window);
+    }
+
+    if (wmRecorder.file)
+        WMRecordStartup(adopted);
+
+    LOG(INFO) << "adopted " << wmClientSlotIndex.size() << " of " << windows.size() << " windows in "
+              << (GetMonotonicTimeMicros() - adoptStart) << "us";
+}
+
+void UnmanageClient(xcb_window_t window)
+{
+    Client *client = FindClient(window);
+    if (!client)
+        return;
+
+    for (const PropertyFetch &fetch : client->propertyFetches)
+    {
+        if (fetch.pending)
+            wmServerSource.discardProperty(fetch.sequence);
+    }
+
+    const xcb_window_t transientFor = client->transientFor;
+    uint32_t stackIdx = client->stackIdx;
+
+    if (transientFor)
+    {
+        CHECK_EQ(client->subwindowCount, 0);
+        if (Client *parent = FindClient(transientFor))
+        {
+            stackIdx = parent->stackIdx;
+            RemoveSubwindow(*parent, *client);
+        }
     }
     else
     {
-        for (xcb_window_t subwindow : client.subwindows)
+        for (uint32_t slot = client->firstSubwindow; slot != kNoSlot;)
         {
-            wmClients.at(subwindow).transientFor = 0;
+            Client &subwindow = wmClients[slot];
+            slot = subwindow.nextSibling;
+
+            subwindow.transientFor = 0;
+            subwindow.nextSibling = kNoSlot;
         }
     }
 
-    wmClients.erase(it);
+    ReleaseClient(*client);
+
+    if (stackIdx == kNoSlot)
+        return;
+
+    WindowStack &stack = wmStacks.at(stackIdx);
+    stack.layoutDirty = true;
 
-    for (size_t istack = 0; istack < wmStacks.size(); ++istack)
+    if (!transientFor)
     {
-        WindowStack &stack = wmStacks.at(istack);
+        auto it = std::ranges::find(stack.windows, window);
+        CHECK(it != stack.windows.end());
 
-        auto it = std::ranges::find(stack.windows, client.transientFor ? client.transientFor : window);
-        if (it == stack.windows.end())
-        {
-            continue;
-        }
+        wmFollow = false;
+        stack.zoom = false;
+        stack.windows.erase(it);
+    }
 
-        wmLayoutDirty = true;
-        if (!client.transientFor)
-        {
-            wmFollow = false;
-            stack.zoom = false;
-            stack.windows.erase(it);
-        }
+    if (stack.activeWindow == window)
+    {
+        stack.activeWindow = 0;
 
-        if (stack.activeWindow == window)
+        if (stackIdx == ActiveStackIdx())
         {
-            stack.activeWindow = 0;
-
-            if (istack == (wmActiveStackIdx & 0xFF))
+            xcb_window_t fallbackTo = transientFor;
+            if (!fallbackTo && !stack.windows.empty())
             {
-                xcb_window_t fallbackTo = client.transientFor;
-                if (!fallbackTo && !stack.windows.empty())
-                {
-                    fallbackTo = stack.windows.front();
-                }
-
-                Activate(stack, fallbackTo, XCB_CURRENT_TIME);
+                fallbackTo = stack.windows.front();
             }
-        }
 
-        return;
+            Activate(stack, fallbackTo, XCB_CURRENT_TIME);
+        }
     }
 }
 
-static void ConfigureClientIfNeeded(xcb_connection_t *conn, xcb_window_t clientWindow, Client &client,
-                                    const Rect &newRect, uint32_t newBorderWidth)
+static void ConfigureClientIfNeeded(xcb_window_t clientWindow, Client &client, const Rect &newRect,
+                                    uint32_t newBorderWidth)
 {
     uint16_t mask = 0;
-    std::vector<uint32_t> values;
-    bool anythingChanged = false;
-    bool sizeChanged = false;
+    std::array<uint32_t, kWMConfigureValueCount> values{};
 
-    if (newRect.X() != client.rect.X())
-    {
-        anythingChanged = true;
-        mask |= XCB_CONFIG_WINDOW_X;
-        values.emplace_back(newRect.X());
-    }
+    auto set = [&mask, &values](uint16_t bit, uint32_t value) -> void {
+        mask |= bit;
+        values[std::countr_zero(bit)] = value;
+    };
 
+    if (newRect.X() != client.rect.X())
+        set(XCB_CONFIG_WINDOW_X, newRect.X());
     if (newRect.Y() != client.rect.Y())
-    {
-        anythingChanged = true;
-        mask |= XCB_CONFIG_WINDOW_Y;
-        values.emplace_back(newRect.Y());
-    }
-
+        set(XCB_CONFIG_WINDOW_Y, newRect.Y());
     if (newRect.Width() != client.rect.Width())
-    {
-        anythingChanged = true;
-        sizeChanged = true;
-        mask |= XCB_CONFIG_WINDOW_WIDTH;
-        values.emplace_back(newRect.Width());
-    }
-
+        set(XCB_CONFIG_WINDOW_WIDTH, newRect.Width());
     if (newRect.Height() != client.rect.Height())
-    {
-        anythingChanged = true;
-        sizeChanged = true;
-        mask |= XCB_CONFIG_WINDOW_HEIGHT;
-        values.emplace_back(newRect.Height());
-    }
-
+        set(XCB_CONFIG_WINDOW_HEIGHT, newRect.Height());
     if (newBorderWidth != client.borderWidth)
+        set(XCB_CONFIG_WINDOW_BORDER_WIDTH, newBorderWidth);
+
+    if (!mask)
     {
-        anythingChanged = true;
-        sizeChanged = true;
-        mask |= XCB_CONFIG_WINDOW_BORDER_WIDTH;
-        values.emplace_back(newBorderWidth);
+        ++wmLayoutStats.configuresAvoided;
+        return;
     }
 
-    if (anythingChanged)
-    {
-        xcb_configure_window(conn, clientWindow, mask, values.data());
+    ++wmLayoutStats.configuresSent;
+    WMConfigureWindow(clientWindow, mask, values);
 
-        client.wantsConfigureNotify = !sizeChanged;
-        client.rect = newRect;
-        client.borderWidth = newBorderWidth;
-    }
+    const bool sizeChanged =
+        mask & (XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT | XCB_CONFIG_WINDOW_BORDER_WIDTH);
+    if (sizeChanged)
+        client.wantsConfigureNotify = false;
+    else
+        RequestConfigureNotify(clientWindow, client);
+    client.rect = newRect;
+    client.borderWidth = newBorderWidth;
+}
+
+static void Reparent(xcb_window_t clientWindow, Client &client, xcb_window_t container)
+{
+    if (client.container == container)
+        return;
+
+    // Managed clients are always mapped, so the server unmaps them before reparenting.
+    ++client.ignoreUnmaps;
+    WMReparentWindow(clientWindow, container ? container : x11.screen->root, client.rect.X(), client.rect.Y());
+    client.container = container;
+}
+
+static void AttachToContainer(xcb_window_t clientWindow, Client &client, const WindowStack &stack)
+{
+    if (wmHideStrategy != WMHideStrategy::KContainers)
+        return;
+
+    Reparent(clientWindow, client, stack.container);
+    ForEachSubwindow(client,
+                     [&stack](Client &subwindow) -> void { Reparent(subwindow.window, subwindow, stack.container); });
+}
+
+static void SetWmState(xcb_window_t clientWindow, WmState state)
+{
+    const uint32_t values[] = {static_cast<uint32_t>(state), XCB_NONE};
+    WMChangeProperty(clientWindow, x11.atoms.wm_state, x11.atoms.wm_state, values);
+}
+
+static void SetNetWmState(xcb_window_t clientWindow, const Client &client)
+{
+    std::vector<uint32_t> states{client.otherNetWmStates.begin(), client.otherNetWmStates.end()};
+    if (client.iconic)
+        states.emplace_back(x11.atoms.net_wm_state_hidden);
+    if (client.fullscreen)
+        states.emplace_back(x11.atoms.net_wm_state_fullscreen);
+    WMChangeProperty(clientWindow, x11.atoms.net_wm_state, XCB_ATOM_ATOM, states);
+}
+
+static void Iconify(xcb_window_t clientWindow, Client &client)
+{
+    if (client.iconic)
+        return;
+    client.iconic = true;
+
+    ++client.ignoreUnmaps;
+    WMUnmapWindow(clientWindow);
+
+    SetWmState(clientWindow, WmState::KIconic);
+    SetNetWmState(clientWindow, client);
+}
+
+static void Deiconify(xcb_window_t clientWindow, Client &client)
+{
+    if (!client.iconic)
+        return;
+    client.iconic = false;
+
+    WMMapWindow(clientWindow);
+
+    SetWmState(clientWindow, WmState::KNormal);
+    SetNetWmState(clientWindow, client);
+}
+
+static void IconifyAll(xcb_window_t clientWindow, Client &client)
+{
+    Iconify(clientWindow, client);
+    ForEachSubwindow(client, [](Client &subwindow) -> void { Iconify(subwindow.window, subwindow); });
+}
+
+static void DeiconifyAll(xcb_window_t clientWindow, Client &client)
+{
+    Deiconify(clientWindow, client);
+    ForEachSubwindow(client, [](Client &subwindow) -> void { Deiconify(subwindow.window, subwindow); });
 }
 
 static void MoveStack(xcb_timestamp_t time, auto computeIdx)
 {
-    size_t iold = wmActiveStackIdx & 0xFF;
-    size_t inew = computeIdx(iold + wmStacks.size()) % wmStacks.size();
+    Output &output = wmOutputs.at(wmActiveOutputIdx);
+    const uint32_t firstStack = wmActiveOutputIdx * kStacksPerOutput;
+
+    size_t iold = output.activeStack - firstStack;
+    size_t inew = computeIdx(iold + kStacksPerOutput) % kStacksPerOutput;
 
     if (iold == inew)
         return;
@@ -556,15 +1217,37 @@ static void MoveStack(xcb_timestamp_t time, auto computeIdx)
     wmBackgroundDirty = true;
 
     WindowStack &oldstack = GetActiveStack();
-    wmActiveStackIdx = inew;
+    output.activeStack = firstStack + inew;
     WindowStack &newstack = GetActiveStack();
 
+    if (wmHideStrategy == WMHideStrategy::KContainers)
+    {
+        WMMapWindow(newstack.container);
+        WMUnmapWindow(oldstack.container);
+    }
+
+    // Focus can only go to viewable windows, so the new stack is mapped before it is activated.
+    if (wmHideStrategy == WMHideStrategy::KIconify)
+    {
+        for (xcb_window_t clientWindow : newstack.windows)
+            DeiconifyAll(clientWindow, GetClient(clientWindow));
+    }
+
     if (wmFollow)
     {
         if (oldstack.activeWindow)
         {
+            Client &client = GetClient(oldstack.activeWindow);
+
             newstack.activeWindow = oldstack.activeWindow;
             newstack.windows.emplace_back(oldstack.activeWindow);
+            client.stackIdx = output.activeStack;
+
+            if (wmHideStrategy == WMHideStrategy::KContainers)
+            {
+                AttachToContainer(newstack.activeWindow, client, newstack);
+                Activate(newstack, time);
+            }
 
             newstack.zoom = false;
             oldstack.zoom = false;
@@ -581,11 +1264,15 @@ static void MoveStack(xcb_timestamp_t time, auto computeIdx)
     }
     else
     {
-        ApplyBorder(x11.conn, oldstack.activeWindow, Color::KNone);
+        ApplyBorder(oldstack.activeWindow, Color::KNone);
         Activate(newstack, newstack.activeWindow, time);
+
+        if (wmHideStrategy == WMHideStrategy::KContainers)
+            return;
     }
 
-    wmLayoutDirty = true;
+    oldstack.layoutDirty = true;
+    newstack.layoutDirty = true;
 }
 
 void MoveStackNext(xcb_timestamp_t time)
@@ -598,6 +1285,242 @@ void MoveStackPrev(xcb_timestamp_t time)
     MoveStack(time, [](auto idx) -> auto { return idx - 1; });
 }
 
+auto SwitchToStack(uint32_t stackIdx, xcb_timestamp_t time) -> bool
+{
+    if (stackIdx >= kStacksPerOutput)
+        return false;
+
+    MoveStack(time, [stackIdx](auto) -> auto { return stackIdx; });
+    return true;
+}
+
+auto FocusWindow(xcb_window_t window, xcb_timestamp_t time) -> bool
+{
+    const Client *client = FindClient(window);
+    if (!client)
+        return false;
+
+    const uint32_t stackIdx = ClientStackIdx(*client);
+    if (stackIdx == kNoSlot)
+        return false;
+
+    wmFollow = false;
+    SetActiveOutput(stackIdx / kStacksPerOutput, time);
+    SwitchToStack(stackIdx % kStacksPerOutput, time);
+
+    WindowStack &stack = GetActiveStack();
+    if (stack.activeWindow != window)
+        ClearZoom(stack);
+    Activate(stack, window, time);
+    return true;
+}
+
+auto MoveActiveToStack(uint32_t stackIdx, xcb_timestamp_t time) -> bool
+{
+    if (stackIdx >= kStacksPerOutput)
+        return false;
+
+    WindowStack &from = GetActiveStack();
+    const uint32_t toIdx = wmActiveOutputIdx * kStacksPerOutput + stackIdx;
+    Client *client = FindClient(from.activeWindow);
+    if (!client || client->transientFor || client->stackIdx == toIdx)
+        return true;
+
+    const xcb_window_t clientWindow = from.activeWindow;
+    WindowStack &to = wmStacks.at(toIdx);
+
+    std::erase(from.windows, clientWindow);
+    to.windows.emplace_back(clientWindow);
+    ApplyBorder(to.activeWindow, Color::KNone);
+    to.activeWindow = clientWindow;
+    client->stackIdx = toIdx;
+    AttachToContainer(clientWindow, *client, to);
+
+    from.zoom = false;
+    to.zoom = false;
+    from.layoutDirty = true;
+    to.layoutDirty = true;
+
+    Activate(from, from.windows.empty() ? 0 : from.windows.front(), time);
+    return true;
+}
+
+static void ConfigureContainers(const Output &output, uint32_t outputIdx)
+{
+    if (wmHideStrategy != WMHideStrategy::KContainers)
+        return;
+
+    std::array<uint32_t, kWMConfigureValueCount> values{};
+    values[std::countr_zero<uint16_t>(XCB_CONFIG_WINDOW_X)] = output.rect.X();
+    values[std::countr_zero<uint16_t>(XCB_CONFIG_WINDOW_Y)] = output.rect.Y();
+    values[std::countr_zero<uint16_t>(XCB_CONFIG_WINDOW_WIDTH)] = output.rect.Width();
+    values[std::countr_zero<uint16_t>(XCB_CONFIG_WINDOW_HEIGHT)] = output.rect.Height();
+
+    const uint16_t mask =
+        XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT;
+    for (uint32_t i = 0; i < kStacksPerOutput; ++i)
+        WMConfigureWindow(wmStacks[outputIdx * kStacksPerOutput + i].container, mask, values);
+}
+
+// Only stacks of this output are marked, the others keep their layout.
+static void SetOutputRect(uint32_t outputIdx, const Rect &rect)
+{
+    Output &output = wmOutputs[outputIdx];
+    output.rect = rect;
+    ConfigureContainers(output, outputIdx);
+
+    for (uint32_t i = 0; i < kStacksPerOutput; ++i)
+        wmStacks[outputIdx * kStacksPerOutput + i].layoutDirty = true;
+}
+
+static auto AddOutput(xcb_atom_t name, const Rect &rect) -> uint32_t
+{
+    const uint32_t outputIdx = wmOutputs.size();
+    wmOutputs.emplace_back(Output{
+        .name = name,
+        .rect = rect,
+        .activeStack = outputIdx * kStacksPerOutput,
+        .connected = true,
+    });
+    wmStacks.resize(wmStacks.size() + kStacksPerOutput);
+
+    if (wmHideStrategy == WMHideStrategy::KContainers)
+    {
+        for (uint32_t i = 0; i < kStacksPerOutput; ++i)
+            wmStacks[outputIdx * kStacksPerOutput + i].container = CreateContainer(rect);
+        WMMapWindow(wmStacks[outputIdx * kStacksPerOutput].container);
+    }
+    return outputIdx;
+}
+
+// Windows of a disconnected output go to the same-numbered stacks of the fallback output.
+static void DisconnectOutput(uint32_t outputIdx, uint32_t fallbackIdx)
+{
+    Output &output = wmOutputs[outputIdx];
+    output.connected = false;
+
+    for (uint32_t i = 0; i < kStacksPerOutput; ++i)
+    {
+        WindowStack &from = wmStacks[outputIdx * kStacksPerOutput + i];
+        if (from.windows.empty())
+            continue;
+
+        const uint32_t toIdx = fallbackIdx * kStacksPerOutput + i;
+        WindowStack &to = wmStacks[toIdx];
+
+        for (xcb_window_t clientWindow : from.windows)
+        {
+            Client &client = GetClient(clientWindow);
+            client.stackIdx = toIdx;
+            AttachToContainer(clientWindow, client, to);
+            to.windows.emplace_back(clientWindow);
+        }
+        if (!to.activeWindow)
+            to.activeWindow = from.activeWindow;
+        to.layoutDirty = true;
+
+        from.windows.clear();
+        from.activeWindow = 0;
+        from.zoom = false;
+    }
+
+    if (wmHideStrategy == WMHideStrategy::KContainers)
+        WMUnmapWindow(wmStacks[output.activeStack].container);
+
+    if (wmActiveOutputIdx == outputIdx)
+    {
+        wmActiveOutputIdx = fallbackIdx;
+        wmFollow = false;
+        wmBorderDirty = true;
+        wmBackgroundDirty = true;
+        Activate(GetActiveStack(), XCB_CURRENT_TIME);
+    }
+}
+
+// Matches the current monitors to output slots by name, only outputs that appeared, went away or changed geometry are
+// touched.
+static void UpdateOutputs()
+{
+    std::vector<X11Monitor> monitors = wmServerSource.queryMonitors();
+    if (wmRecorder.file)
+        WMRecordMonitors(monitors);
+    std::vector<bool> present(wmOutputs.size());
+    uint32_t primaryIdx = kNoSlot;
+
+    for (const X11Monitor &monitor : monitors)
+    {
+        const Rect rect{monitor.x, monitor.y, monitor.width, monitor.height};
+
+        uint32_t outputIdx = std::ranges::find(wmOutputs, monitor.name, &Output::name) - wmOutputs.begin();
+        if (outputIdx == wmOutputs.size())
+        {
+            outputIdx = AddOutput(monitor.name, rect);
+            present.emplace_back(true);
+        }
+        else
+        {
+            Output &output = wmOutputs[outputIdx];
+            present[outputIdx] = true;
+
+            if (!output.connected)
+            {
+                output.connected = true;
+                SetOutputRect(outputIdx, rect);
+                if (wmHideStrategy == WMHideStrategy::KContainers)
+                    WMMapWindow(wmStacks[output.activeStack].container);
+            }
+            else if (output.rect != rect)
+            {
+                SetOutputRect(outputIdx, rect);
+            }
+        }
+
+        if (monitor.primary || primaryIdx == kNoSlot)
+            primaryIdx = outputIdx;
+    }
+    wmPrimaryOutputIdx = primaryIdx;
+
+    for (uint32_t outputIdx = 0; outputIdx < wmOutputs.size(); ++outputIdx)
+    {
+        if (wmOutputs[outputIdx].connected && !present[outputIdx])
+        {
+            LOG(INFO) << "output " << wmOutputs[outputIdx].name << " disconnected";
+            DisconnectOutput(outputIdx, wmPrimaryOutputIdx);
+        }
+    }
+}
+
+static void HandleScreenChange(const xcb_randr_screen_change_notify_event_t &screenchange)
+{
+    const uint16_t oldWidth = x11.screen->width_in_pixels;
+    const uint16_t oldHeight = x11.screen->height_in_pixels;
+
+    // Offscreen hiding goes by the screen size, which the setup data the connection started with does not follow.
+    if (screenchange.rotation & (XCB_RANDR_ROTATION_ROTATE_90 | XCB_RANDR_ROTATION_ROTATE_270))
+    {
+        x11.screen->width_in_pixels = screenchange.height;
+        x11.screen->height_in_pixels = screenchange.width;
+    }
+    else
+    {
+        x11.screen->width_in_pixels = screenchange.width;
+        x11.screen->height_in_pixels = screenchange.height;
+    }
+
+    // Windows hidden at the old corner of a grown screen would show up again.
+    if (wmHideStrategy == WMHideStrategy::KOffscreen &&
+        (x11.screen->width_in_pixels > oldWidth || x11.screen->height_in_pixels > oldHeight))
+    {
+        for (uint32_t stackIdx = 0; stackIdx < wmStacks.size(); ++stackIdx)
+        {
+            if (!IsStackVisible(stackIdx))
+                wmStacks[stackIdx].layoutDirty = true;
+        }
+    }
+
+    UpdateOutputs();
+}
+
 static void MoveLocal(xcb_timestamp_t time, auto computeIdx)
 {
     WindowStack &stack = GetActiveStack();
@@ -626,7 +1549,7 @@ static void MoveLocal(xcb_timestamp_t time, auto computeIdx)
         if (wmFollow)
         {
             std::iter_swap(stack.windows.begin() + iold, stack.windows.begin() + inew);
-            wmLayoutDirty = true;
+            stack.layoutDirty = true;
         }
         else
         {
@@ -656,18 +1579,18 @@ void NextLayout()
 {
     WindowStack &stack = GetActiveStack();
     CycleLayoutType(stack.layoutType);
-    wmLayoutDirty = true;
+    stack.layoutDirty = true;
     ClearZoom(stack);
 }
 
 auto GetActiveClientBarText() -> std::string
 {
     const WindowStack &stack = GetActiveStack();
-    xcb_window_t activeWindow = stack.activeWindow;
-    if (!activeWindow || !wmClients.contains(activeWindow))
+    const Client *client = FindClient(stack.activeWindow);
+    if (!client)
         return "nyla: no active client";
 
-    return wmClients.at(activeWindow).name;
+    return std::string{ClientName(*client)};
 }
 
 void CloseActive()
@@ -679,7 +1602,7 @@ void CloseActive()
     static absl::Time last = absl::InfinitePast();
     if (absl::Now() - last >= absl::Milliseconds(100))
     {
-        X11SendWmDeleteWindow(stack.activeWindow);
+        WMSendDeleteWindow(stack.activeWindow);
     }
     last = absl::Now();
 }
@@ -689,7 +1612,7 @@ void ToggleZoom()
     WindowStack &stack = GetActiveStack();
     stack.zoom ^= 1;
     wmBackgroundDirty = true;
-    wmLayoutDirty = true;
+    stack.layoutDirty = true;
     wmBorderDirty = true;
 }
 
@@ -697,15 +1620,13 @@ void ToggleFollow()
 {
     WindowStack &stack = GetActiveStack();
 
-    auto it = wmClients.find(stack.activeWindow);
-    if (it == wmClients.end())
+    const Client *client = FindClient(stack.activeWindow);
+    if (!client)
     {
         return;
     }
 
-    Client &client = it->second;
-
-    if (!stack.activeWindow || client.transientFor)
+    if (!stack.activeWindow || client->transientFor)
     {
         wmFollow = false;
         return;
@@ -718,348 +1639,834 @@ void ToggleFollow()
     wmBorderDirty = true;
 }
 
-//
+void ToggleFullscreen()
+{
+    const WindowStack &stack = GetActiveStack();
+    Client *client = FindClient(stack.activeWindow);
+    if (!client)
+        return;
 
-void ProcessWM()
+    client->fullscreen ^= 1;
+    SetNetWmState(stack.activeWindow, *client);
+}
+
+static void EnterGameMode(xcb_window_t clientWindow)
 {
-    for (auto &[client_window, client] : wmClients)
-    {
-        for (auto &[property, cookie] : client.propertyCookies)
-        {
-            xcb_get_property_reply_t *reply = xcb_get_property_reply(x11.conn, cookie, nullptr);
-            if (!reply)
-                continue;
+    const uint32_t stackIdx = ActiveStackIdx();
+    WindowStack &stack = wmStacks.at(stackIdx);
 
-            auto handlerIt = wmPropertyChangeHandlers.find(property);
-            if (handlerIt == wmPropertyChangeHandlers.end())
-            {
-                LOG(ERROR) << "missing property change handler " << property;
-                continue;
-            }
+    wmGameMode = {.window = clientWindow, .stackIdx = stackIdx, .restoreZoom = stack.zoom};
 
-            handlerIt->second(client_window, client, reply);
-            free(reply);
-        }
-        client.propertyCookies.clear();
+    // Zoom already gives the active client the whole output without a border.
+    wmFollow = false;
+    stack.zoom = true;
+    stack.layoutDirty = true;
+    wmBorderDirty = true;
+
+    if (wmMotionIdleTimer)
+    {
+        TimerCancel(wmMotionIdleTimer);
+        wmMotionIdleTimer = 0;
+    }
+    if (wmRawMotionSelected)
+    {
+        WMSelectRawMotion(false);
+        wmRawMotionSelected = false;
     }
 
-    WindowStack &stack = GetActiveStack();
+    const uint32_t gameMode = 1;
+    WMChangeProperty(x11.screen->root, x11.atoms.nyla_wm_game_mode, XCB_ATOM_CARDINAL, {&gameMode, 1});
 
-    if (!wmPendingClients.empty())
-    {
-        for (xcb_window_t clientWindow : wmPendingClients)
-        {
-            auto it = wmClients.find(clientWindow);
-            if (it == wmClients.end())
-                continue;
+    LOG(INFO) << "game mode on for " << clientWindow;
+}
 
-            auto &[_, client] = *it;
-            if (client.transientFor)
-            {
-                bool found = false;
-                for (int i = 0; i < 10; ++i)
-                {
-                    auto it = wmClients.find(client.transientFor);
-                    if (it == wmClients.end())
-                        break;
+static void LeaveGameMode()
+{
+    if (FindClient(wmGameMode.window))
+    {
+        WindowStack &stack = wmStacks.at(wmGameMode.stackIdx);
+        stack.zoom = wmGameMode.restoreZoom;
+        stack.layoutDirty = true;
+    }
+    wmGameMode = {};
+    wmBorderDirty = true;
 
-                    xcb_window_t nextTransient = it->second.transientFor;
-                    if (!nextTransient)
-                    {
-                        found = true;
-                        break;
-                    }
-                    client.transientFor = nextTransient;
-                }
-                if (!found)
-                    client.transientFor = 0;
-            }
+    // Motion is selected again right away, the idle timer takes it away once the pointer stays still.
+    WMSelectRawMotion(true);
+    wmRawMotionSelected = true;
 
-            if (!client.transientFor || client.transientFor != stack.activeWindow)
-                ClearZoom(stack);
-        }
+    // Deleted rather than cleared, wm_overlay follows the property from PropertyNotify alone and never reads it back.
+    WMDeleteProperty(x11.screen->root, x11.atoms.nyla_wm_game_mode);
 
-        bool activated = false;
-        for (xcb_window_t clientWindow : wmPendingClients)
+    for (Client &client : wmClients)
+    {
+        for (uint32_t propertyIdx = 0; client.window && propertyIdx < kTrackedPropertyCount; ++propertyIdx)
         {
-            const auto &client = wmClients.at(clientWindow);
-            if (client.transientFor)
-            {
-                Client &parent = wmClients.at(client.transientFor);
-                parent.subwindows.push_back(clientWindow);
-            }
-            else
-            {
-                stack.windows.emplace_back(clientWindow);
-
-                if (!activated)
-                {
-                    Activate(stack, clientWindow, XCB_CURRENT_TIME);
-                    activated = true;
-                }
-            }
+            const TrackedProperty &tracked = wmTrackedProperties[propertyIdx];
+            if (!tracked.lazy && (client.staleProperties & (1 << propertyIdx)))
+                FetchClientProperty(client.window, client, tracked.atom);
         }
-
-        wmPendingClients.clear();
-        wmFollow = false;
-        wmLayoutDirty = true;
     }
 
-    if (wmBorderDirty)
-    {
-        Color color = [&stack] -> nyla::Color {
-            if (wmFollow)
-                return Color::KActiveFollow;
-            if (stack.zoom || stack.windows.size() < 2)
-                return Color::KNone;
-            return Color::KActive;
-        }();
-        ApplyBorder(x11.conn, stack.activeWindow, color);
+    LOG(INFO) << "game mode off";
+}
 
-        wmBorderDirty = false;
+// Game mode follows the fullscreen state of whatever is the active window of the active stack.
+// Requests sent to the root window, only fullscreen is acted on.
+static void HandleNetWmStateMessage(const xcb_client_message_event_t &clientmessage)
+{
+    Client *client = FindClient(clientmessage.window);
+    if (!client || clientmessage.format != 32)
+        return;
+
+    const uint32_t *data = clientmessage.data.data32;
+    if (data[1] != x11.atoms.net_wm_state_fullscreen && data[2] != x11.atoms.net_wm_state_fullscreen)
+        return;
+
+    // _NET_WM_STATE_REMOVE, _NET_WM_STATE_ADD and _NET_WM_STATE_TOGGLE.
+    switch (data[0])
+    {
+    case 0:
+        client->fullscreen = false;
+        break;
+    case 1:
+        client->fullscreen = true;
+        break;
+    case 2:
+        client->fullscreen ^= 1;
+        break;
+    default:
+        return;
     }
+    SetNetWmState(clientmessage.window, *client);
+}
+
+static void UpdateGameMode()
+{
+    const WindowStack &stack = GetActiveStack();
+    const Client *client = FindClient(stack.activeWindow);
+    const xcb_window_t fullscreenWindow = client && client->fullscreen ? stack.activeWindow : 0;
+    if (fullscreenWindow == wmGameMode.window)
+        return;
+
+    if (wmGameMode.window)
+        LeaveGameMode();
+    if (fullscreenWindow)
+        EnterGameMode(fullscreenWindow);
+}
+
+//
+
+static void HarvestPropertyReplies()
+{
+    std::erase_if(wmClientsAwaitingReplies, [](xcb_window_t clientWindow) -> bool {
+        Client *client = FindClient(clientWindow);
+        if (!client)
+            return true;
+
+        for (uint32_t propertyIdx = 0; propertyIdx < kTrackedPropertyCount; ++propertyIdx)
+        {
+            PropertyFetch &fetch = client->propertyFetches[propertyIdx];
+            if (!fetch.pending)
+                continue;
+
+            const xcb_atom_t property = wmTrackedProperties[propertyIdx].atom;
+
+            xcb_get_property_reply_t *reply = nullptr;
+            if (!wmServerSource.pollForProperty(fetch.sequence, clientWindow, property, &reply))
+                continue;
+
+            if (wmRecorder.file)
+                WMRecordPropertyReply(clientWindow, property, reply);
 
-    if (wmLayoutDirty)
+            fetch.pending = false;
+            --client->pendingFetches;
+            if (fetch.initial)
+                --client->initialFetches;
+
+            wmCompletedReplies.emplace_back(PropertyReply{
+                .window = clientWindow,
+                .propertyIdx = propertyIdx,
+                .reply = reply,
+            });
+        }
+
+        return !client->pendingFetches;
+    });
+}
+
+static void DispatchPropertyReplies()
+{
+    for (auto &[clientWindow, propertyIdx, reply] : wmCompletedReplies)
     {
-        Rect screenRect = Rect(x11.screen->width_in_pixels, x11.screen->height_in_pixels);
-        if (!stack.zoom)
-            screenRect = TryApplyMarginTop(screenRect, wmBarHeight);
+        absl::Cleanup replyFreer = [reply] -> void { free(reply); };
+        if (!reply)
+            continue;
 
-        auto hide = [](xcb_window_t clientWindow, Client &client) -> void {
-            ConfigureClientIfNeeded(x11.conn, clientWindow, client,
-                                    Rect{x11.screen->width_in_pixels, x11.screen->height_in_pixels, client.rect.Width(),
-                                         client.rect.Height()},
-                                    client.borderWidth);
-        };
+        Client *client = FindClient(clientWindow);
+        if (!client)
+            continue;
 
-        auto hideAll = [hide](xcb_window_t clientWindow, Client &client) -> void {
-            hide(clientWindow, client);
-            for (xcb_window_t subwindow : client.subwindows)
-                hide(subwindow, wmClients.at(subwindow));
-        };
+        // A value cut off at the per-property cap still gets handled, readers can ask for the rest.
+        if (reply->bytes_after)
+            client->truncatedProperties |= 1 << propertyIdx;
+        else
+            client->truncatedProperties &= ~(1 << propertyIdx);
 
-        auto configureWindows = [](Rect boundingRect, std::span<const xcb_window_t> windows, LayoutType layoutType,
-                                   auto visitor) -> auto {
-            std::vector<Rect> layout = ComputeLayout(boundingRect, windows.size(), 2, layoutType);
-            CHECK_EQ(layout.size(), windows.size());
+        wmTrackedProperties[propertyIdx].handler(clientWindow, *client, reply);
+        ++wmPropertyStats[propertyIdx].handled;
+    }
+    wmCompletedReplies.clear();
+}
 
-            for (auto [rect, client_window] : std::ranges::views::zip(layout, windows))
-            {
-                Client &client = wmClients.at(client_window);
+static void HideClient(xcb_window_t clientWindow, Client &client)
+{
+    ConfigureClientIfNeeded(
+        clientWindow, client,
+        Rect{x11.screen->width_in_pixels, x11.screen->height_in_pixels, client.rect.Width(), client.rect.Height()},
+        client.borderWidth);
+}
 
-                auto center = [](uint32_t max, uint32_t &w, int32_t &x) -> void {
-                    if (max)
-                    {
-                        uint32_t tmp = std::min(max, w);
-                        x += (w - tmp) / 2;
-                        w = tmp;
-                    }
-                };
-                center(client.maxWidth, rect.Width(), rect.X());
-                center(client.maxHeight, rect.Height(), rect.Y());
+static void HideAll(xcb_window_t clientWindow, Client &client)
+{
+    HideClient(clientWindow, client);
+    ForEachSubwindow(client, [](Client &subwindow) -> void { HideClient(subwindow.window, subwindow); });
+}
 
-                ConfigureClientIfNeeded(x11.conn, client_window, client, rect, 2);
+static void LayoutStack(WindowStack &stack, Rect screenRect)
+{
+    if (!stack.zoom)
+        screenRect = TryApplyMarginTop(screenRect, wmBarHeight);
 
-                visitor(client);
+    auto configureClient = [](Client &client, Rect rect) -> void {
+        auto center = [](uint32_t max, uint32_t &w, int32_t &x) -> void {
+            if (max)
+            {
+                uint32_t tmp = std::min(max, w);
+                x += (w - tmp) / 2;
+                w = tmp;
             }
         };
+        center(client.maxWidth, rect.Width(), rect.X());
+        center(client.maxHeight, rect.Height(), rect.Y());
 
-        auto configureSubwindows = [configureWindows](const Client &client) -> void {
-            configureWindows(TryApplyMargin(client.rect, 20), client.subwindows, LayoutType::KRows,
-                             [](Client &client) -> void {});
-        };
+        ConfigureClientIfNeeded(client.window, client, rect, 2);
+        Deiconify(client.window, client);
+    };
 
-        if (stack.zoom)
+    auto configureSubwindows = [configureClient](const Client &client) -> void {
+        if (!client.subwindowCount)
+            return;
+
+        const uint64_t computeStart = GetMonotonicTimeMicros();
+        std::vector<Rect> layout =
+            ComputeLayout(TryApplyMargin(client.rect, 20), client.subwindowCount, 2, LayoutType::KRows);
+        RecordLatency(wmPhaseLatency.computeLayout, computeStart);
+
+        uint32_t i = 0;
+        ForEachSubwindow(client, [&layout, &i, configureClient](Client &subwindow) -> void {
+            configureClient(subwindow, layout.at(i++));
+        });
+    };
+
+    if (stack.zoom)
+    {
+        for (xcb_window_t clientWindow : stack.windows)
         {
-            for (xcb_window_t clientWindow : stack.windows)
+            Client &client = GetClient(clientWindow);
+
+            if (clientWindow != stack.activeWindow)
             {
-                auto &client = wmClients.at(clientWindow);
+                HideAll(clientWindow, client);
+            }
+            else
+            {
+                ConfigureClientIfNeeded(clientWindow, client, screenRect, wmFollow ? 2 : 0);
+                Deiconify(clientWindow, client);
+
+                configureSubwindows(client);
+            }
+        }
+    }
+    else
+    {
+        const uint64_t computeStart = GetMonotonicTimeMicros();
+        if (UpdateLayoutMemo(stack.layoutMemo, screenRect, stack.windows.size(), 2, stack.layoutType))
+        {
+            ++wmLayoutStats.layoutsComputed;
+            RecordLatency(wmPhaseLatency.computeLayout, computeStart);
+        }
+        else
+            ++wmLayoutStats.layoutsMemoized;
+
+        CHECK_EQ(stack.layoutMemo.rects.size(), stack.windows.size());
+        for (auto [layoutRect, clientWindow] : std::ranges::views::zip(stack.layoutMemo.rects, stack.windows))
+        {
+            Client &client = GetClient(clientWindow);
+            configureClient(client, layoutRect);
+            configureSubwindows(client);
+        }
+    }
+
+    stack.layoutDirty = false;
+}
 
-                if (clientWindow != stack.activeWindow)
+void ProcessWM()
+{
+    const uint64_t start = GetMonotonicTimeMicros();
+    uint64_t phaseStart = start;
+
+    HarvestPropertyReplies();
+    DispatchPropertyReplies();
+    phaseStart = RecordLatency(wmPhaseLatency.replies, phaseStart);
+
+    UpdateGameMode();
+
+    WindowStack &stack = GetActiveStack();
+
+    std::vector<xcb_window_t> readyClients;
+    std::erase_if(wmPendingClients, [&readyClients](xcb_window_t clientWindow) -> bool {
+        const Client *client = FindClient(clientWindow);
+        if (!client)
+            return true;
+        if (client->initialFetches)
+            return false;
+
+        readyClients.emplace_back(clientWindow);
+        return true;
+    });
+
+    if (!readyClients.empty())
+    {
+        for (xcb_window_t clientWindow : readyClients)
+        {
+            Client &client = GetClient(clientWindow);
+            if (client.transientFor)
+            {
+                bool found = false;
+                for (int i = 0; i < 10; ++i)
                 {
-                    hideAll(clientWindow, client);
+                    const Client *parent = FindClient(client.transientFor);
+                    if (!parent)
+                        break;
+
+                    xcb_window_t nextTransient = parent->transientFor;
+                    if (!nextTransient)
+                    {
+                        found = true;
+                        break;
+                    }
+                    client.transientFor = nextTransient;
                 }
-                else
+                if (!found)
+                    client.transientFor = 0;
+            }
+
+            if (!client.transientFor || client.transientFor != stack.activeWindow)
+                ClearZoom(stack);
+        }
+
+        bool activated = false;
+        for (xcb_window_t clientWindow : readyClients)
+        {
+            Client &client = GetClient(clientWindow);
+            if (client.transientFor)
+            {
+                Client &parent = GetClient(client.transientFor);
+                AddSubwindow(parent, client);
+
+                if (WindowStack *parentStack = FindStack(parent))
                 {
-                    ConfigureClientIfNeeded(x11.conn, clientWindow, client, screenRect, wmFollow ? 2 : 0);
+                    AttachToContainer(clientWindow, client, *parentStack);
+                    parentStack->layoutDirty = true;
+                }
+            }
+            else
+            {
+                stack.windows.emplace_back(clientWindow);
+                client.stackIdx = ActiveStackIdx();
+                AttachToContainer(clientWindow, client, stack);
 
-                    configureSubwindows(client);
+                if (!activated)
+                {
+                    Activate(stack, clientWindow, XCB_CURRENT_TIME);
+                    activated = true;
                 }
             }
+
+            RecordLatency(wmPhaseLatency.mapToManaged, client.manageStartMicros);
         }
-        else
+
+        wmFollow = false;
+        stack.layoutDirty = true;
+    }
+
+    if (wmBorderDirty)
+    {
+        Color color = [&stack] -> nyla::Color {
+            if (wmFollow)
+                return Color::KActiveFollow;
+            if (stack.zoom || stack.windows.size() < 2)
+                return Color::KNone;
+            return Color::KActive;
+        }();
+        ApplyBorder(stack.activeWindow, color);
+
+        wmBorderDirty = false;
+    }
+    phaseStart = RecordLatency(wmPhaseLatency.manage, phaseStart);
+
+    // Each output lays out only its own visible stack.
+    bool laidOut = false;
+    for (const Output &output : wmOutputs)
+    {
+        WindowStack &visibleStack = wmStacks.at(output.activeStack);
+        if (!output.connected || !visibleStack.layoutDirty)
+            continue;
+
+        LayoutStack(visibleStack, OutputLayoutRect(output));
+        laidOut = true;
+    }
+    if (laidOut)
+        phaseStart = RecordLatency(wmPhaseLatency.layout, phaseStart);
+
+    // Unmapped containers already hide their windows, those stacks are laid out once they become active again.
+    for (size_t istack = 0; istack < wmStacks.size() && wmHideStrategy != WMHideStrategy::KContainers; ++istack)
+    {
+        WindowStack &hiddenStack = wmStacks[istack];
+        if (IsStackVisible(istack) || !hiddenStack.layoutDirty)
+            continue;
+
+        for (xcb_window_t clientWindow : hiddenStack.windows)
         {
-            configureWindows(screenRect, stack.windows, stack.layoutType, configureSubwindows);
+            if (wmHideStrategy == WMHideStrategy::KIconify)
+                IconifyAll(clientWindow, GetClient(clientWindow));
+            else
+                HideAll(clientWindow, GetClient(clientWindow));
         }
 
-        for (size_t istack = 0; istack < wmStacks.size(); ++istack)
+        hiddenStack.layoutDirty = false;
+    }
+    phaseStart = RecordLatency(wmPhaseLatency.hiddenStacks, phaseStart);
+
+    for (xcb_window_t clientWindow : wmConfigureNotifyQueue)
+    {
+        Client *client = FindClient(clientWindow);
+        if (!client)
+            continue;
+
+        if (client->wantsConfigureNotify)
         {
-            if (istack != (wmActiveStackIdx & 0xFF))
-            {
-                for (xcb_window_t clientWindow : wmStacks[istack].windows)
-                    hideAll(clientWindow, wmClients.at(clientWindow));
-            }
+            WMSendConfigureNotify(clientWindow, x11.screen->root, client->rect.X(), client->rect.Y(),
+                                  client->rect.Width(), client->rect.Height(), 2);
+            client->wantsConfigureNotify = false;
         }
-
-        wmLayoutDirty = false;
     }
+    wmConfigureNotifyQueue.clear();
+    RecordLatency(wmPhaseLatency.configureNotify, phaseStart);
+
+    RecordLatency(wmPhaseLatency.total, start);
+
+    if (wmRecorder.file)
+        WMRecordProcessWM();
 
-    for (auto &[client_window, client] : wmClients)
+    if (wmActiveStateObserver)
     {
-        if (client.wantsConfigureNotify)
+        static WMActiveState observed;
+        static std::string observedTitle;
+
+        const WMActiveState state = WMGetActiveState();
+        if (state.window != observed.window || state.outputIdx != observed.outputIdx ||
+            state.stackIdx != observed.stackIdx || state.title != observedTitle)
         {
-            X11SendConfigureNotify(client_window, x11.screen->root, client.rect.X(), client.rect.Y(),
-                                   client.rect.Width(), client.rect.Height(), 2);
-            client.wantsConfigureNotify = false;
+            observed = state;
+            observedTitle = state.title;
+            wmActiveStateObserver(state);
         }
     }
 }
 
-void ProcessWMEvents(const bool &isRunning, uint16_t modifier, std::vector<Keybind> keybinds)
+auto WMGetActiveState() -> WMActiveState
 {
-    while (isRunning)
-    {
-        xcb_generic_event_t *event = xcb_poll_for_event(x11.conn);
-        if (!event)
-            break;
-        absl::Cleanup eventFreer = [event] -> void { free(event); };
+    const xcb_window_t window = GetActiveStack().activeWindow;
+    const Client *client = FindClient(window);
+    return {
+        .window = window,
+        .outputIdx = wmActiveOutputIdx,
+        .stackIdx = ActiveStackIdx() % kStacksPerOutput,
+        .title = client ? ClientName(*client) : std::string_view{},
+    };
+}
 
-        bool isSynthethic = event->response_type & 0x80;
-        uint8_t eventType = event->response_type & 0x7F;
+void KeybindTableInitialize(KeybindTable &table, uint16_t numLockModifier)
+{
+    table.lockModifiers = XCB_MOD_MASK_LOCK | numLockModifier;
+    table.handlers.clear();
+    table.slots.fill(0);
+}
 
-        WindowStack &stack = GetActiveStack();
+void KeybindTableAdd(KeybindTable &table, xcb_keycode_t keycode, uint16_t modifiers, KeybindHandler handler)
+{
+    CHECK_LT(table.handlers.size(), std::numeric_limits<uint8_t>::max());
+    CHECK_LE(modifiers & ~table.lockModifiers, 0xFF);
+    table.handlers.emplace_back(handler);
+    table.slots[keycode << 8 | (modifiers & ~table.lockModifiers)] = table.handlers.size();
+}
+
+static auto KeybindTableLookup(const KeybindTable &table, xcb_keycode_t keycode, uint16_t state)
+    -> const KeybindHandler *
+{
+    // Modifiers must match exactly, a held pointer button sets bits above 0xFF and matches nothing.
+    const uint16_t modifiers = state & ~table.lockModifiers;
+    if (modifiers > 0xFF)
+        return nullptr;
+
+    const uint8_t slot = table.slots[keycode << 8 | modifiers];
+    if (!slot)
+        return nullptr;
+    return &table.handlers[slot - 1];
+}
+
+static void HandleEvent(xcb_generic_event_t *event, const KeybindTable &keybinds)
+{
+    bool isSynthethic = event->response_type & 0x80;
+    uint8_t eventType = event->response_type & 0x7F;
 
-        if (isSynthethic && eventType != XCB_CLIENT_MESSAGE)
+    if (x11.extRandr && eventType == x11.extRandr->first_event + XCB_RANDR_SCREEN_CHANGE_NOTIFY)
+    {
+        HandleScreenChange(*reinterpret_cast<xcb_randr_screen_change_notify_event_t *>(event));
+        return;
+    }
+
+    if (isSynthethic && eventType != XCB_CLIENT_MESSAGE)
+    {
+        // continue;
+    }
+
+    switch (eventType)
+    {
+    case XCB_KEY_PRESS: {
+        auto keypress = reinterpret_cast<xcb_key_press_event_t *>(event);
+        if (const KeybindHandler *fn = KeybindTableLookup(keybinds, keypress->detail, keypress->state))
         {
-            // continue;
+            if (std::holds_alternative<void (*)()>(*fn))
+            {
+                std::get<void (*)()>(*fn)();
+            }
+            else if (std::holds_alternative<void (*)(xcb_timestamp_t time)>(*fn))
+            {
+                std::get<void (*)(xcb_timestamp_t time)>(*fn)(keypress->time);
+            }
+            else
+            {
+                CHECK(false);
+            }
         }
+        break;
+    }
+    case XCB_PROPERTY_NOTIFY: {
+        auto propertynotify = reinterpret_cast<xcb_property_notify_event_t *>(event);
 
-        switch (eventType)
+        xcb_window_t clientWindow = propertynotify->window;
+        if (Client *client = FindClient(clientWindow))
         {
-        case XCB_KEY_PRESS: {
-            auto keypress = reinterpret_cast<xcb_key_press_event_t *>(event);
-            if (keypress->state == modifier)
+            const uint32_t propertyIdx = FindTrackedProperty(propertynotify->atom);
+            if (propertyIdx != kNoSlot && clientWindow != GetActiveStack().activeWindow &&
+                (wmTrackedProperties[propertyIdx].lazy || wmGameMode.window))
             {
-                for (const auto &[keycode, mod, fn] : keybinds)
-                {
-                    if (mod == keypress->state && keycode == keypress->detail)
-                    {
-                        if (std::holds_alternative<void (*)()>(fn))
-                        {
-                            std::get<void (*)()>(fn)();
-                        }
-                        else if (std::holds_alternative<void (*)(xcb_timestamp_t time)>(fn))
-                        {
-                            std::get<void (*)(xcb_timestamp_t time)>(fn)(keypress->time);
-                        }
-                        else
-                        {
-                            CHECK(false);
-                        }
-                        break;
-                    }
-                }
+                client->staleProperties |= 1 << propertyIdx;
+                ++wmPropertyStats[propertyIdx].deferred;
             }
+            else
+                FetchClientProperty(clientWindow, *client, propertynotify->atom);
+        }
+        break;
+    }
+    case XCB_CONFIGURE_REQUEST: {
+        auto configurerequest = reinterpret_cast<xcb_configure_request_event_t *>(event);
+        if (Client *client = FindClient(configurerequest->window))
+        {
+            RequestConfigureNotify(configurerequest->window, *client);
+        }
+        break;
+    }
+    case XCB_MAP_REQUEST: {
+        xcb_window_t window = reinterpret_cast<xcb_map_request_event_t *>(event)->window;
+
+        // Iconified clients belong to an inactive stack and are mapped when it is shown.
+        if (const Client *client = FindClient(window); client && client->iconic)
             break;
+
+        WMMapWindow(window);
+        break;
+    }
+    case XCB_MAP_NOTIFY: {
+        auto mapnotify = reinterpret_cast<xcb_map_notify_event_t *>(event);
+        if (!mapnotify->override_redirect)
+        {
+            xcb_window_t window = reinterpret_cast<xcb_map_notify_event_t *>(event)->window;
+            ManageClient(window);
         }
-        case XCB_PROPERTY_NOTIFY: {
-            auto propertynotify = reinterpret_cast<xcb_property_notify_event_t *>(event);
+        break;
+    }
+    case XCB_CLIENT_MESSAGE: {
+        auto clientmessage = reinterpret_cast<xcb_client_message_event_t *>(event);
+        if (clientmessage->type == x11.atoms.net_wm_state)
+            HandleNetWmStateMessage(*clientmessage);
+        break;
+    }
+    case XCB_MAPPING_NOTIFY: {
+        // auto mappingnotify =
+        //     reinterpret_cast<xcb_mapping_notify_event_t*>(event);
+        LOG(INFO) << "mapping notify";
+        break;
+    }
+    case XCB_UNMAP_NOTIFY: {
+        xcb_window_t window = reinterpret_cast<xcb_unmap_notify_event_t *>(event)->window;
 
-            xcb_window_t clientWindow = propertynotify->window;
-            auto it = wmClients.find(clientWindow);
-            if (it != wmClients.end())
-            {
-                FetchClientProperty(clientWindow, it->second, propertynotify->atom);
-            }
+        Client *client = FindClient(window);
+        if (!client)
+            break;
+
+        if (client->ignoreUnmaps)
+        {
+            --client->ignoreUnmaps;
             break;
         }
-        case XCB_CONFIGURE_REQUEST: {
-            auto configurerequest = reinterpret_cast<xcb_configure_request_event_t *>(event);
-            auto it = wmClients.find(configurerequest->window);
-            if (it != wmClients.end())
+
+        if (client->container)
+            WMReparentWindow(window, x11.screen->root, client->rect.X(), client->rect.Y());
+        if (wmHideStrategy != WMHideStrategy::KOffscreen)
+            WMChangeSaveSet(window, XCB_SET_MODE_DELETE);
+
+        UnmanageClient(window);
+        break;
+    }
+    case XCB_CREATE_NOTIFY: {
+        auto createnotify = reinterpret_cast<xcb_create_notify_event_t *>(event);
+        wmWindowParents.insert_or_assign(createnotify->window, createnotify->parent);
+        break;
+    }
+    case XCB_REPARENT_NOTIFY: {
+        auto reparentnotify = reinterpret_cast<xcb_reparent_notify_event_t *>(event);
+        wmWindowParents.insert_or_assign(reparentnotify->window, reparentnotify->parent);
+        break;
+    }
+    case XCB_DESTROY_NOTIFY: {
+        xcb_window_t window = reinterpret_cast<xcb_destroy_notify_event_t *>(event)->window;
+        wmWindowParents.erase(window);
+        UnmanageClient(window);
+        break;
+    }
+    case XCB_FOCUS_IN: {
+        auto focusin = reinterpret_cast<xcb_focus_in_event_t *>(event);
+        if (focusin->mode == XCB_NOTIFY_MODE_NORMAL)
+            CheckFocusTheft(*focusin);
+        break;
+    }
+    case XCB_EXPOSE: {
+#if 0
+        auto expose = reinterpret_cast<xcb_expose_event_t *>(event);
+        if (expose->window == backgroundWindow)
+            wmBackgroundDirty = true;
+#endif
+        break;
+    }
+
+    case XCB_GE_GENERIC: {
+        auto ge = reinterpret_cast<xcb_ge_generic_event_t *>(event);
+
+        if (ge->extension == x11.extXi2->major_opcode)
+        {
+            switch (ge->event_type)
             {
-                it->second.wantsConfigureNotify = true;
+            case XCB_INPUT_RAW_MOTION: {
+                HandleRawMotion(*reinterpret_cast<xcb_input_raw_motion_event_t *>(event));
+                break;
+            }
             }
-            break;
-        }
-        case XCB_MAP_REQUEST: {
-            xcb_map_window(x11.conn, reinterpret_cast<xcb_map_request_event_t *>(event)->window);
-            break;
         }
-        case XCB_MAP_NOTIFY: {
-            auto mapnotify = reinterpret_cast<xcb_map_notify_event_t *>(event);
-            if (!mapnotify->override_redirect)
+
+        break;
+    }
+
+    case XCB_ENTER_NOTIFY: {
+        HandleEnterNotify(*reinterpret_cast<xcb_enter_notify_event_t *>(event));
+        break;
+    }
+
+    case XCB_MOTION_NOTIFY: {
+        HandleMotionNotify(*reinterpret_cast<xcb_motion_notify_event_t *>(event));
+        break;
+    }
+
+    case 0: {
+        auto error = reinterpret_cast<xcb_generic_error_t *>(event);
+        LOG(ERROR) << "xcb error: " << static_cast<X11ErrorCode>(error->error_code)
+                   << " sequence: " << error->sequence;
+
+        // A client that went away without a DestroyNotify reaching us, as during a restart.
+        if (static_cast<X11ErrorCode>(error->error_code) == X11ErrorCode::KBadWindow)
+            UnmanageClient(error->resource_id);
+        break;
+    }
+    }
+}
+
+static auto IsRawMotion(const xcb_generic_event_t *event) -> bool
+{
+    if ((event->response_type & 0x7F) != XCB_GE_GENERIC)
+        return false;
+
+    auto ge = reinterpret_cast<const xcb_ge_generic_event_t *>(event);
+    return ge->extension == x11.extXi2->major_opcode && ge->event_type == XCB_INPUT_RAW_MOTION;
+}
+
+static auto IsScreenChange(const xcb_generic_event_t *event) -> bool
+{
+    return x11.extRandr && (event->response_type & 0x7F) == x11.extRandr->first_event + XCB_RANDR_SCREEN_CHANGE_NOTIFY;
+}
+
+// Walks the drained events backwards and drops everything a later event supersedes: property notifies for the same
+// (window, atom) only trigger a refetch of the latest value, and only the last crossing, motion and screen change
+// matter.
+static void CoalesceEvents(std::vector<xcb_generic_event_t *> &events)
+{
+    static Set<uint64_t> seenProperties;
+    seenProperties.clear();
+
+    bool seenEnter = false;
+    bool seenMotion = false;
+    bool seenRawMotion = false;
+    bool seenScreenChange = false;
+
+    for (auto it = events.rbegin(); it != events.rend(); ++it)
+    {
+        xcb_generic_event_t *&event = *it;
+
+        bool superseded = false;
+        switch (event->response_type & 0x7F)
+        {
+        case XCB_PROPERTY_NOTIFY: {
+            auto propertynotify = reinterpret_cast<xcb_property_notify_event_t *>(event);
+            superseded = !seenProperties.emplace(uint64_t{propertynotify->window} << 32 | propertynotify->atom).second;
+
+            const uint32_t propertyIdx = FindTrackedProperty(propertynotify->atom);
+            if (propertyIdx != kNoSlot)
             {
-                xcb_window_t window = reinterpret_cast<xcb_map_notify_event_t *>(event)->window;
-                ManageClient(window);
+                ++wmPropertyStats[propertyIdx].notified;
+                if (superseded)
+                    ++wmPropertyStats[propertyIdx].coalesced;
             }
             break;
         }
-        case XCB_MAPPING_NOTIFY: {
-            // auto mappingnotify =
-            //     reinterpret_cast<xcb_mapping_notify_event_t*>(event);
-            LOG(INFO) << "mapping notify";
+        case XCB_ENTER_NOTIFY: {
+            superseded = std::exchange(seenEnter, true);
+            break;
+        }
+        case XCB_MOTION_NOTIFY: {
+            superseded = std::exchange(seenMotion, true);
             break;
         }
-        case XCB_UNMAP_NOTIFY: {
-            UnmanageClient(reinterpret_cast<xcb_unmap_notify_event_t *>(event)->window);
+        case XCB_GE_GENERIC: {
+            if (!IsRawMotion(event))
+                break;
+
+            ++wmMotionStats.received;
+            superseded = std::exchange(seenRawMotion, true);
+            if (superseded)
+                ++wmMotionStats.absorbed;
             break;
         }
-        case XCB_DESTROY_NOTIFY: {
-            UnmanageClient(reinterpret_cast<xcb_destroy_notify_event_t *>(event)->window);
+        default: {
+            if (IsScreenChange(event))
+                superseded = std::exchange(seenScreenChange, true);
             break;
         }
-        case XCB_FOCUS_IN: {
-            auto focusin = reinterpret_cast<xcb_focus_in_event_t *>(event);
-            if (focusin->mode == XCB_NOTIFY_MODE_NORMAL)
-                CheckFocusTheft();
-            break;
         }
-        case XCB_EXPOSE: {
-#if 0
-            auto expose = reinterpret_cast<xcb_expose_event_t *>(event);
-            if (expose->window == backgroundWindow)
-                wmBackgroundDirty = true;
-#endif
-            break;
+
+        if (superseded)
+        {
+            free(event);
+            event = nullptr;
         }
+    }
 
-        case XCB_GE_GENERIC: {
-            auto ge = reinterpret_cast<xcb_ge_generic_event_t *>(event);
+    std::erase(events, nullptr);
+}
 
-            if (ge->extension == x11.extXi2->major_opcode)
-            {
-                switch (ge->event_type)
-                {
-                case XCB_INPUT_RAW_MOTION: {
-                    auto rawmotion = reinterpret_cast<xcb_input_raw_motion_event_t *>(event);
-                    lastRawmotionTs = std::max(lastRawmotionTs, rawmotion->time);
-                    MaybeActivateUnderPointer(stack, lastRawmotionTs);
-                    break;
-                }
-                }
-            }
+// Property notifies only start refetches, so they go last. Everything else keeps its order: a keybind must see the
+// unmaps and destroys that arrived before it.
+static auto EventPriority(const xcb_generic_event_t *event) -> uint32_t
+{
+    return (event->response_type & 0x7F) == XCB_PROPERTY_NOTIFY;
+}
 
-            break;
-        }
+void DispatchWMEvents(std::vector<xcb_generic_event_t *> &events, const KeybindTable &keybinds)
+{
+    wmEventStats.received += events.size();
+    CoalesceEvents(events);
+    wmEventStats.dispatched += events.size();
 
-        case XCB_ENTER_NOTIFY: {
-            auto enternotify = reinterpret_cast<xcb_enter_notify_event_t *>(event);
-            lastEnteredWindow = enternotify->event;
-            MaybeActivateUnderPointer(stack, enternotify->time);
-            break;
-        }
+    std::ranges::stable_sort(events, {}, EventPriority);
+
+    for (xcb_generic_event_t *event : events)
+    {
+        const uint64_t start = GetMonotonicTimeMicros();
+        HandleEvent(event, keybinds);
+        RecordLatency(wmEventLatency[event->response_type & 0x7F], start);
+        free(event);
+    }
+    events.clear();
+}
 
-        case 0: {
-            auto error = reinterpret_cast<xcb_generic_error_t *>(event);
-            LOG(ERROR) << "xcb error: " << static_cast<X11ErrorCode>(error->error_code)
-                       << " sequence: " << error->sequence;
+static std::vector<xcb_generic_event_t *> wmEventBatch;
+
+void ProcessWMEvents(const bool &isRunning, const KeybindTable &keybinds)
+{
+    while (isRunning)
+    {
+        while (xcb_generic_event_t *event = wmServerSource.pollForEvent(false))
+            wmEventBatch.emplace_back(event);
+        if (wmEventBatch.empty())
             break;
+
+        if (wmRecorder.file)
+        {
+            for (const xcb_generic_event_t *event : wmEventBatch)
+                WMRecordEvent(event);
+            WMRecordEventBatchEnd();
         }
-        }
+
+        DispatchWMEvents(wmEventBatch, keybinds);
     }
 }
 
+static auto TakeQueuedEvent() -> bool
+{
+    xcb_generic_event_t *event = wmServerSource.pollForEvent(true);
+    if (!event)
+        return false;
+    wmEventBatch.emplace_back(event);
+    return true;
+}
+
+void RunWM(const bool &isRunning, const KeybindTable &keybinds)
+{
+    do
+    {
+        ProcessWMEvents(isRunning, keybinds);
+        ProcessWM();
+        WMCommandsFlush();
+    } while (isRunning && TakeQueuedEvent());
+}
+
+void RunWMIfQueued(const bool &isRunning, const KeybindTable &keybinds)
+{
+    if (isRunning && TakeQueuedEvent())
+        RunWM(isRunning, keybinds);
+}
+
 void UpdateBackground()
 {
 #if 0
@@ -1069,18 +2476,18 @@ void UpdateBackground()
 
     if (stack.activeWindow)
     {
-        auto it = wmClients.find(stack.activeWindow);
-        if (it == wmClients.end())
+        const Client *client = FindClient(stack.activeWindow);
+        if (!client)
             activeClientName = absl::StrFormat("invalid %v", stack.activeWindow);
         else
         {
-            activeClientName = it->second.name;
+            activeClientName = ClientName(*client);
             std::erase_if(activeClientName, [](char ch) -> bool { return ch < 0x20 || ch > 0x7F; });
         }
     }
     else
     {
-        activeClientName = absl::StrFormat("nylawm %v", wmActiveStackIdx & 0xFF);
+        activeClientName = absl::StrFormat("nylawm %v", ActiveStackIdx());
     }
 
     double loadAvg[3];
@@ -1094,9 +2501,10 @@ void UpdateBackground()
     if (IsFutureReady(fut))
     {
         wmBackgroundDirty = false;
-        fut = std::async(std::launch::async, [wmClientSize = wmClients.size(), barText = std::move(barText)] -> void {
-            DrawBackground(wmClientSize, barText);
-        });
+        fut = std::async(std::launch::async,
+                         [wmClientSize = wmClientSlotIndex.size(), barText = std::move(barText)] -> void {
+                             DrawBackground(wmClientSize, barText);
+                         });
     }
 #endif
 }
@@ -1105,16 +2513,27 @@ static auto DumpClients() -> std::string
 {
     std::string out;
 
+    // Names shown here may lag by one read while the requested values are in flight.
+    for (Client &client : wmClients)
+    {
+        if (client.window)
+            RequestPropertyForReader(client, XCB_ATOM_WM_NAME);
+    }
+    WMCommandsFlush();
+
     const WindowStack &stack = GetActiveStack();
 
     absl::StrAppendFormat(&out, "active window = %x\n\n", stack.activeWindow);
 
-    for (const auto &[client_window, client] : wmClients)
+    for (const Client &client : wmClients)
     {
+        if (!client.window)
+            continue;
+
         std::string_view indent = [&client]() -> const char * {
             if (client.transientFor)
                 return "  T  ";
-            if (!client.subwindows.empty())
+            if (client.subwindowCount)
                 return "  S  ";
             return "";
         }();
@@ -1122,14 +2541,14 @@ static auto DumpClients() -> std::string
         std::string transientForName;
         if (client.transientFor)
         {
-            auto it = wmClients.find(client.transientFor);
-            if (it == wmClients.end())
+            const Client *parent = FindClient(client.transientFor);
+            if (!parent)
             {
                 transientForName = "invalid " + std::to_string(client.transientFor);
             }
             else
             {
-                transientForName = it->second.name + " " + std::to_string(client.transientFor);
+                transientForName = std::string{ClientName(*parent)} + " " + std::to_string(client.transientFor);
             }
         }
         else
@@ -1137,17 +2556,612 @@ static auto DumpClients() -> std::string
             transientForName = "none";
         }
 
+        std::vector<xcb_window_t> subwindows;
+        ForEachSubwindow(client, [&subwindows](const Client &subwindow) -> void {
+            subwindows.emplace_back(subwindow.window);
+        });
+
         absl::StrAppendFormat(&out,
                               "%swindow=%x\n%sname=%v\n%srect=%v\n%swm_"
                               "transient_for=%v\n%sinput=%v\n"
                               "%swm_take_focus=%v\n%swm_delete_window=%v\n%"
                               "ssubwindows=%v\n%smax_dimensions=%vx%v\n\n",
-                              indent, client_window, indent, client.name, indent, client.rect, indent, transientForName,
-                              indent, client.wmHintsInput, indent, client.wmTakeFocus, indent, client.wmDeleteWindow,
-                              indent, absl::StrJoin(client.subwindows, ", "), indent, client.maxWidth,
+                              indent, client.window, indent, ClientName(client), indent, client.rect, indent,
+                              transientForName, indent, client.wmHintsInput, indent, client.wmTakeFocus, indent,
+                              client.wmDeleteWindow, indent, absl::StrJoin(subwindows, ", "), indent, client.maxWidth,
                               client.maxHeight);
     }
     return out;
 }
 
+static auto DumpLayoutStats() -> std::string
+{
+    return absl::StrFormat("configures_sent: %v\n"
+                           "configures_avoided: %v\n"
+                           "layouts_computed: %v\n"
+                           "layouts_memoized: %v\n",
+                           wmLayoutStats.configuresSent, wmLayoutStats.configuresAvoided,
+                           wmLayoutStats.layoutsComputed, wmLayoutStats.layoutsMemoized);
+}
+
+static auto DumpEventStats() -> std::string
+{
+    return absl::StrFormat("received: %v\n"
+                           "dispatched: %v\n",
+                           wmEventStats.received, wmEventStats.dispatched);
+}
+
+// One line per tracked property. pending counts the fetches still waiting for a reply, a reader that saw notified catch
+// up with its changes knows they were handled once it drops to zero.
+static auto DumpPropertyStats() -> std::string
+{
+    std::string out;
+    for (uint32_t propertyIdx = 0; propertyIdx < kTrackedPropertyCount; ++propertyIdx)
+    {
+        uint64_t pending = 0;
+        for (const Client &client : wmClients)
+            pending += client.window && client.propertyFetches[propertyIdx].pending;
+
+        const PropertyStats &stats = wmPropertyStats[propertyIdx];
+        absl::StrAppendFormat(&out, "%s: notified %v coalesced %v deferred %v fetched %v handled %v pending %v\n",
+                              wmTrackedProperties[propertyIdx].name, stats.notified, stats.coalesced, stats.deferred,
+                              stats.fetched, stats.handled, pending);
+    }
+    return out;
+}
+
+static auto DumpMotionStats() -> std::string
+{
+    return absl::StrFormat("received: %v\n"
+                           "absorbed: %v\n"
+                           "deselected: %v\n"
+                           "reselected: %v\n"
+                           "selected: %v\n",
+                           wmMotionStats.received, wmMotionStats.absorbed, wmMotionStats.deselected,
+                           wmMotionStats.reselected, wmRawMotionSelected);
+}
+
+static auto DumpCommandStats() -> std::string
+{
+    return absl::StrFormat("queued: %v\n"
+                           "superseded: %v\n"
+                           "sent: %v\n"
+                           "flushes: %v\n",
+                           wmCommands.stats.queued, wmCommands.stats.superseded, wmCommands.stats.sent,
+                           wmCommands.stats.flushes);
+}
+
+static auto EventTypeName(uint8_t eventType) -> std::string
+{
+    if (x11.extRandr && eventType == x11.extRandr->first_event + XCB_RANDR_SCREEN_CHANGE_NOTIFY)
+        return "screen_change";
+
+    switch (eventType)
+    {
+    case 0:
+        return "error";
+    case XCB_KEY_PRESS:
+        return "key_press";
+    case XCB_ENTER_NOTIFY:
+        return "enter_notify";
+    case XCB_MOTION_NOTIFY:
+        return "motion_notify";
+    case XCB_FOCUS_IN:
+        return "focus_in";
+    case XCB_EXPOSE:
+        return "expose";
+    case XCB_CREATE_NOTIFY:
+        return "create_notify";
+    case XCB_DESTROY_NOTIFY:
+        return "destroy_notify";
+    case XCB_UNMAP_NOTIFY:
+        return "unmap_notify";
+    case XCB_MAP_NOTIFY:
+        return "map_notify";
+    case XCB_MAP_REQUEST:
+        return "map_request";
+    case XCB_REPARENT_NOTIFY:
+        return "reparent_notify";
+    case XCB_CONFIGURE_REQUEST:
+        return "configure_request";
+    case XCB_PROPERTY_NOTIFY:
+        return "property_notify";
+    case XCB_MAPPING_NOTIFY:
+        return "mapping_notify";
+    case XCB_CLIENT_MESSAGE:
+        return "client_message";
+    case XCB_GE_GENERIC:
+        return "raw_motion";
+    }
+    return absl::StrFormat("event_%v", eventType);
+}
+
+static auto DumpEventLatency() -> std::string
+{
+    std::vector<uint8_t> eventTypes;
+    for (const auto &[eventType, _] : wmEventLatency)
+        eventTypes.emplace_back(eventType);
+    std::ranges::sort(eventTypes);
+
+    std::string out;
+    for (uint8_t eventType : eventTypes)
+        absl::StrAppendFormat(&out, "%s: %s\n", EventTypeName(eventType),
+                              LatencyHistogramFormat(wmEventLatency.at(eventType)));
+    return out;
+}
+
+static auto DumpPhaseLatency() -> std::string
+{
+    return absl::StrFormat("map_to_managed: %s\n"
+                           "replies: %s\n"
+                           "manage: %s\n"
+                           "layout: %s\n"
+                           "compute_layout: %s\n"
+                           "hidden_stacks: %s\n"
+                           "configure_notify: %s\n"
+                           "total: %s\n",
+                           LatencyHistogramFormat(wmPhaseLatency.mapToManaged),
+                           LatencyHistogramFormat(wmPhaseLatency.replies),
+                           LatencyHistogramFormat(wmPhaseLatency.manage),
+                           LatencyHistogramFormat(wmPhaseLatency.layout),
+                           LatencyHistogramFormat(wmPhaseLatency.computeLayout),
+                           LatencyHistogramFormat(wmPhaseLatency.hiddenStacks),
+                           LatencyHistogramFormat(wmPhaseLatency.configureNotify),
+                           LatencyHistogramFormat(wmPhaseLatency.total));
+}
+
+auto WMLatencyReport() -> std::string
+{
+    return DumpEventLatency() + DumpPhaseLatency();
+}
+
+//
+
+// Written in host byte order for the next binary on the same machine, the magic changes with the layout. Padding is
+// spelled out so that designated initializers zero it, no uninitialized bytes end up in the state.
+static constexpr char kHandoffMagic[8] = {'N', 'Y', 'L', 'A', 'W', 'M', 'H', '3'};
+
+struct HandoffHeader
+{
+    char magic[8];
+    WMHideStrategy hideStrategy;
+    xcb_atom_t activeOutputName;
+    uint32_t outputCount;
+    uint32_t clientCount;
+    uint32_t pendingCount;
+};
+
+struct HandoffOutput
+{
+    xcb_atom_t name;
+    uint32_t activeStack;
+    bool connected;
+    uint8_t padding[3];
+};
+
+// Subwindows follow their parent, which they name in transientFor. The name and the other _NET_WM_STATE atoms follow
+// each client.
+struct HandoffClient
+{
+    xcb_window_t window;
+    int32_t x;
+    int32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t borderWidth;
+    uint32_t maxWidth;
+    uint32_t maxHeight;
+    xcb_window_t transientFor;
+    bool wmHintsInput;
+    bool wmTakeFocus;
+    bool wmDeleteWindow;
+    bool urgent;
+    bool iconic;
+    bool fullscreen;
+    uint8_t truncatedProperties;
+    uint8_t padding;
+    uint32_t nameLength;
+    uint32_t otherNetWmStateCount;
+};
+
+struct HandoffStack
+{
+    LayoutType layoutType;
+    bool zoom;
+    uint8_t padding[3];
+    xcb_window_t activeWindow;
+    uint32_t windowCount;
+};
+
+template <typename T> static void AppendPod(std::string &out, const T &value)
+{
+    static_assert(std::has_unique_object_representations_v<T>, "implicit padding would be written uninitialized");
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T> static auto ConsumePod(std::string_view &in, T &value) -> bool
+{
+    if (in.size() < sizeof(value))
+        return false;
+    memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return true;
+}
+
+// Counts come from the state itself. Every record takes at least sizeof(T) bytes, so a count beyond what is left is
+// rejected before anything is allocated for it.
+template <typename T> static auto CountFits(std::string_view in, uint64_t count) -> bool
+{
+    return count <= in.size() / sizeof(T);
+}
+
+auto WMHandoffSave(int fd) -> bool
+{
+    std::vector<const Client *> managed;
+    Set<xcb_window_t> managedWindows;
+    for (const Client &client : wmClients)
+    {
+        if (!client.window || client.stackIdx == kNoSlot)
+            continue;
+
+        managed.emplace_back(&client);
+        ForEachSubwindow(client, [&managed](const Client &subwindow) -> void { managed.emplace_back(&subwindow); });
+    }
+    for (const Client *client : managed)
+        managedWindows.emplace(client->window);
+
+    // Clients still waiting for their initial properties, or orphaned by their parent, are managed afresh.
+    std::vector<xcb_window_t> pending;
+    for (const Client &client : wmClients)
+    {
+        if (client.window && !managedWindows.contains(client.window))
+            pending.emplace_back(client.window);
+    }
+
+    std::string out;
+    HandoffHeader header{
+        .hideStrategy = wmHideStrategy,
+        .activeOutputName = wmOutputs.at(wmActiveOutputIdx).name,
+        .outputCount = static_cast<uint32_t>(wmOutputs.size()),
+        .clientCount = static_cast<uint32_t>(managed.size()),
+        .pendingCount = static_cast<uint32_t>(pending.size()),
+    };
+    memcpy(header.magic, kHandoffMagic, sizeof(kHandoffMagic));
+    AppendPod(out, header);
+
+    for (const Output &output : wmOutputs)
+    {
+        AppendPod(out, HandoffOutput{
+                           .name = output.name,
+                           .activeStack = output.activeStack % kStacksPerOutput,
+                           .connected = output.connected,
+                       });
+    }
+
+    for (const Client *client : managed)
+    {
+        const std::string_view name = ClientName(*client);
+        AppendPod(out, HandoffClient{
+                           .window = client->window,
+                           .x = client->rect.X(),
+                           .y = client->rect.Y(),
+                           .width = client->rect.Width(),
+                           .height = client->rect.Height(),
+                           .borderWidth = client->borderWidth,
+                           .maxWidth = client->maxWidth,
+                           .maxHeight = client->maxHeight,
+                           .transientFor = client->stackIdx == kNoSlot ? client->transientFor : 0,
+                           .wmHintsInput = client->wmHintsInput,
+                           .wmTakeFocus = client->wmTakeFocus,
+                           .wmDeleteWindow = client->wmDeleteWindow,
+                           .urgent = client->urgent,
+                           .iconic = client->iconic,
+                           .fullscreen = client->fullscreen,
+                           .truncatedProperties = client->truncatedProperties,
+                           .nameLength = static_cast<uint32_t>(name.size()),
+                           .otherNetWmStateCount = static_cast<uint32_t>(client->otherNetWmStates.size()),
+                       });
+        out.append(name);
+        for (xcb_atom_t state : client->otherNetWmStates)
+            AppendPod(out, state);
+    }
+
+    for (xcb_window_t window : pending)
+        AppendPod(out, window);
+
+    for (const WindowStack &stack : wmStacks)
+    {
+        AppendPod(out, HandoffStack{
+                           .layoutType = stack.layoutType,
+                           .zoom = stack.zoom,
+                           .activeWindow = stack.activeWindow,
+                           .windowCount = static_cast<uint32_t>(stack.windows.size()),
+                       });
+        for (xcb_window_t window : stack.windows)
+            AppendPod(out, window);
+    }
+
+    if (pwrite(fd, out.data(), out.size(), 0) != static_cast<ssize_t>(out.size()))
+    {
+        PLOG(ERROR) << "could not write the handoff state";
+        return false;
+    }
+
+    // The server maps unmapped save-set windows when this connection closes, iconified clients would flash up.
+    if (wmHideStrategy == WMHideStrategy::KIconify)
+    {
+        for (const Client *client : managed)
+        {
+            if (client->iconic)
+                WMChangeSaveSet(client->window, XCB_SET_MODE_DELETE);
+        }
+    }
+    WMCommandsFlush();
+
+    LOG(INFO) << "handing off " << managed.size() << " clients in " << out.size() << " bytes";
+    return true;
+}
+
+void WMHandoffCancel()
+{
+    if (wmHideStrategy != WMHideStrategy::KIconify)
+        return;
+
+    for (const Client &client : wmClients)
+    {
+        if (client.window && client.iconic)
+            WMChangeSaveSet(client.window, XCB_SET_MODE_INSERT);
+    }
+    WMCommandsFlush();
+}
+
+// The whole state is parsed before any of it is applied, a truncated or corrupt state leaves the WM untouched for
+// ManageClientsStartup to take over.
+struct ParsedHandoffClient
+{
+    HandoffClient saved;
+    std::string_view name;
+    std::vector<xcb_atom_t> otherNetWmStates;
+};
+
+struct ParsedHandoffStack
+{
+    HandoffStack saved;
+    std::vector<xcb_window_t> windows;
+};
+
+struct ParsedHandoff
+{
+    HandoffHeader header;
+    std::vector<HandoffOutput> outputs;
+    std::vector<ParsedHandoffClient> clients;
+    std::vector<xcb_window_t> pending;
+    std::vector<ParsedHandoffStack> stacks;
+};
+
+static auto ParseHandoff(std::string_view in, ParsedHandoff &parsed) -> bool
+{
+    if (!ConsumePod(in, parsed.header))
+        return false;
+
+    if (!CountFits<HandoffOutput>(in, parsed.header.outputCount))
+        return false;
+    parsed.outputs.resize(parsed.header.outputCount);
+    for (HandoffOutput &output : parsed.outputs)
+    {
+        if (!ConsumePod(in, output))
+            return false;
+    }
+
+    if (!CountFits<HandoffClient>(in, parsed.header.clientCount))
+        return false;
+    parsed.clients.resize(parsed.header.clientCount);
+    for (ParsedHandoffClient &client : parsed.clients)
+    {
+        if (!ConsumePod(in, client.saved) || in.size() < client.saved.nameLength)
+            return false;
+
+        client.name = in.substr(0, client.saved.nameLength);
+        in.remove_prefix(client.saved.nameLength);
+
+        if (!CountFits<xcb_atom_t>(in, client.saved.otherNetWmStateCount))
+            return false;
+        client.otherNetWmStates.resize(client.saved.otherNetWmStateCount);
+        for (xcb_atom_t &state : client.otherNetWmStates)
+        {
+            if (!ConsumePod(in, state))
+                return false;
+        }
+    }
+
+    if (!CountFits<xcb_window_t>(in, parsed.header.pendingCount))
+        return false;
+    parsed.pending.resize(parsed.header.pendingCount);
+    for (xcb_window_t &window : parsed.pending)
+    {
+        if (!ConsumePod(in, window))
+            return false;
+    }
+
+    const uint64_t stackCount = uint64_t{parsed.header.outputCount} * kStacksPerOutput;
+    if (!CountFits<HandoffStack>(in, stackCount))
+        return false;
+    parsed.stacks.resize(stackCount);
+    for (ParsedHandoffStack &stack : parsed.stacks)
+    {
+        if (!ConsumePod(in, stack.saved))
+            return false;
+
+        if (!CountFits<xcb_window_t>(in, stack.saved.windowCount))
+            return false;
+        stack.windows.resize(stack.saved.windowCount);
+        for (xcb_window_t &window : stack.windows)
+        {
+            if (!ConsumePod(in, window))
+                return false;
+        }
+    }
+
+    return in.empty();
+}
+
+auto WMHandoffRestore(int fd) -> bool
+{
+    struct stat st;
+    if (fstat(fd, &st))
+        return false;
+
+    std::string buffer(st.st_size, '\0');
+    if (pread(fd, buffer.data(), buffer.size(), 0) != static_cast<ssize_t>(buffer.size()))
+        return false;
+
+    HandoffHeader header;
+    std::string_view magic = buffer;
+    if (!ConsumePod(magic, header) || memcmp(header.magic, kHandoffMagic, sizeof(kHandoffMagic)))
+    {
+        LOG(ERROR) << "handoff state has an unknown format";
+        return false;
+    }
+    if (header.hideStrategy != wmHideStrategy)
+    {
+        LOG(ERROR) << "handoff state was written with a different hide strategy";
+        return false;
+    }
+
+    ParsedHandoff parsed;
+    if (!ParseHandoff(buffer, parsed))
+    {
+        LOG(ERROR) << "handoff state is truncated or corrupt";
+        return false;
+    }
+
+    if (wmRecorder.file)
+        WMRecordHandoff(buffer);
+
+    // Saved output slots are matched to the current ones by name, stacks of vanished outputs go to the primary one.
+    std::vector<uint32_t> outputMap(parsed.outputs.size());
+    for (uint32_t savedIdx = 0; savedIdx < parsed.outputs.size(); ++savedIdx)
+    {
+        const HandoffOutput &saved = parsed.outputs[savedIdx];
+        uint32_t &outputIdx = outputMap[savedIdx];
+
+        outputIdx = std::ranges::find(wmOutputs, saved.name, &Output::name) - wmOutputs.begin();
+        if (outputIdx == wmOutputs.size() || !wmOutputs[outputIdx].connected || !saved.connected)
+        {
+            outputIdx = wmPrimaryOutputIdx;
+            continue;
+        }
+
+        Output &output = wmOutputs[outputIdx];
+        const uint32_t activeStack = outputIdx * kStacksPerOutput + saved.activeStack % kStacksPerOutput;
+        if (wmHideStrategy == WMHideStrategy::KContainers && activeStack != output.activeStack)
+        {
+            WMMapWindow(wmStacks[activeStack].container);
+            WMUnmapWindow(wmStacks[output.activeStack].container);
+        }
+        output.activeStack = activeStack;
+
+        if (saved.name == header.activeOutputName)
+            wmActiveOutputIdx = outputIdx;
+    }
+
+    for (ParsedHandoffClient &parsedClient : parsed.clients)
+    {
+        const HandoffClient &saved = parsedClient.saved;
+        if (wmClientSlotIndex.contains(saved.window))
+            continue;
+        if (saved.transientFor && !FindClient(saved.transientFor))
+        {
+            ManageClient(saved.window);
+            continue;
+        }
+
+        Client &client = AcquireClient(saved.window);
+        client.rect = Rect{saved.x, saved.y, saved.width, saved.height};
+        client.borderWidth = saved.borderWidth;
+        client.name = parsedClient.name.empty() ? nullptr : InternName(parsedClient.name);
+        client.wmHintsInput = saved.wmHintsInput;
+        client.wmTakeFocus = saved.wmTakeFocus;
+        client.wmDeleteWindow = saved.wmDeleteWindow;
+        client.maxWidth = saved.maxWidth;
+        client.maxHeight = saved.maxHeight;
+        client.urgent = saved.urgent;
+        client.iconic = saved.iconic;
+        client.fullscreen = saved.fullscreen;
+        client.otherNetWmStates = std::move(parsedClient.otherNetWmStates);
+        client.truncatedProperties = saved.truncatedProperties;
+
+        for (uint32_t propertyIdx = 0; propertyIdx < kTrackedPropertyCount; ++propertyIdx)
+        {
+            if (wmTrackedProperties[propertyIdx].lazy)
+                client.staleProperties |= 1 << propertyIdx;
+        }
+
+        if (saved.transientFor)
+        {
+            client.transientFor = saved.transientFor;
+            AddSubwindow(GetClient(saved.transientFor), client);
+        }
+
+        // Event selections and the save set belong to the connection, which went away with the old process. With
+        // containers the save set has already moved the client back to the root window.
+        WMChangeWindowAttribute(saved.window, XCB_CW_EVENT_MASK, kClientEventMask);
+        if (wmHideStrategy != WMHideStrategy::KOffscreen)
+            WMChangeSaveSet(saved.window, XCB_SET_MODE_INSERT);
+        wmWindowParents.insert_or_assign(saved.window, x11.screen->root);
+    }
+
+    for (xcb_window_t window : parsed.pending)
+        ManageClient(window);
+
+    for (uint32_t savedIdx = 0; savedIdx < parsed.stacks.size(); ++savedIdx)
+    {
+        const auto &[saved, windows] = parsed.stacks[savedIdx];
+
+        const uint32_t stackIdx =
+            outputMap[savedIdx / kStacksPerOutput] * kStacksPerOutput + savedIdx % kStacksPerOutput;
+        WindowStack &stack = wmStacks[stackIdx];
+        if (stack.windows.empty())
+        {
+            stack.layoutType = saved.layoutType;
+            stack.zoom = saved.zoom;
+        }
+        stack.layoutDirty = true;
+
+        for (xcb_window_t window : windows)
+        {
+            Client *client = FindClient(window);
+            if (!client || client->stackIdx != kNoSlot || client->transientFor)
+                continue;
+
+            client->stackIdx = stackIdx;
+            stack.windows.emplace_back(window);
+            AttachToContainer(window, *client, stack);
+        }
+
+        if (!stack.activeWindow && std::ranges::find(stack.windows, saved.activeWindow) != stack.windows.end())
+            stack.activeWindow = saved.activeWindow;
+    }
+
+    // Restored top-level clients the saved stacks did not place would never be shown, they join the active stack.
+    for (Client &client : wmClients)
+    {
+        if (!client.window || client.stackIdx != kNoSlot || client.transientFor ||
+            std::ranges::find(wmPendingClients, client.window) != wmPendingClients.end())
+            continue;
+
+        WindowStack &stack = GetActiveStack();
+        client.stackIdx = ActiveStackIdx();
+        stack.windows.emplace_back(client.window);
+        stack.layoutDirty = true;
+        AttachToContainer(client.window, client, stack);
+    }
+
+    wmBorderDirty = true;
+    Activate(GetActiveStack(), XCB_CURRENT_TIME);
+
+    LOG(INFO) << "restored " << wmClientSlotIndex.size() << " clients from the handoff state";
+    return true;
+}
+
 } // namespace nyla
\ No newline at end of file
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
+#include "xcb/xcb.h"
 #include "xcb/xproto.h"
 
 namespace nyla
@@ -11,23 +16,85 @@ namespace nyla
 
 extern bool wmBackgroundDirty;
 
+enum class WMHideStrategy
+{
+    KOffscreen,
+    KContainers,
+    KIconify,
+};
+extern WMHideStrategy wmHideStrategy;
+
+// Upper bound in Hz on how often raw pointer motion can move focus, 0 disables the cap.
+extern uint32_t wmMotionRateCap;
+
+// Stacks are numbered within their output, title is the WM_NAME of the active window.
+struct WMActiveState
+{
+    xcb_window_t window;
+    uint32_t outputIdx;
+    uint32_t stackIdx;
+    std::string_view title;
+};
+
+auto WMGetActiveState() -> WMActiveState;
+
+// Called at the end of ProcessWM when any part of the active state changed.
+extern void (*wmActiveStateObserver)(const WMActiveState &state);
+
 using KeybindHandler = std::variant<void (*)(xcb_timestamp_t timestamp), void (*)()>;
-using Keybind = std::tuple<xcb_keycode_t, int, KeybindHandler>;
+
+// Indexed by (keycode, modifiers) with the lock modifiers masked out, 0 means unbound.
+struct KeybindTable
+{
+    uint16_t lockModifiers;
+    std::vector<KeybindHandler> handlers;
+    std::array<uint8_t, 256 * 256> slots;
+};
+
+void KeybindTableInitialize(KeybindTable &table, uint16_t numLockModifier);
+void KeybindTableAdd(KeybindTable &table, xcb_keycode_t keycode, uint16_t modifiers, KeybindHandler handler);
 
 //
 
 void InitializeWM();
-void ProcessWMEvents(const bool &isRunning, uint16_t modifier, std::vector<Keybind> keybinds);
+void ProcessWMEvents(const bool &isRunning, const KeybindTable &keybinds);
+void DispatchWMEvents(std::vector<xcb_generic_event_t *> &events, const KeybindTable &keybinds);
 
 void ProcessWM();
+
+// ProcessWMEvents, ProcessWM and a flush, repeated while xcb has events queued.
+void RunWM(const bool &isRunning, const KeybindTable &keybinds);
+// Waiting on replies and flushing both read the socket, and events that come along sit in xcb's queue where they never
+// make the fd readable. This runs RunWM if any did, after anything that may have talked to the server.
+void RunWMIfQueued(const bool &isRunning, const KeybindTable &keybinds);
 void UpdateBackground();
 
-void ManageClientsStartup();
+auto WMLatencyReport() -> std::string;
+
+// A child of the root window found at startup, as queried from the server.
+struct WMExistingWindow
+{
+    xcb_window_t window;
+    bool overrideRedirect;
+    bool mapped;
+};
+
+void ManageClient(xcb_window_t clientWindow);
+void ManageClientsStartup(std::span<const WMExistingWindow> windows);
+
+// Hot restart: WMHandoffSave writes the managed state to fd and readies the server side for this connection going
+// away, WMHandoffCancel undoes that when the exec fails. The new process calls WMHandoffRestore after InitializeWM in
+// place of ManageClientsStartup, it sends requests but waits on no replies.
+auto WMHandoffSave(int fd) -> bool;
+void WMHandoffCancel();
+auto WMHandoffRestore(int fd) -> bool;
 
 void CloseActive();
 
 void ToggleZoom();
 void ToggleFollow();
+// Game mode is on while the active client is fullscreen, clients can also request it through _NET_WM_STATE.
+void ToggleFullscreen();
 
 void MoveLocalNext(xcb_timestamp_t time);
 void MoveLocalPrev(xcb_timestamp_t time);
@@ -37,4 +104,9 @@ void MoveStackPrev(xcb_timestamp_t time);
 
 void NextLayout();
 
+// Return false when the window is not managed or the stack index is out of range.
+auto FocusWindow(xcb_window_t window, xcb_timestamp_t time) -> bool;
+auto SwitchToStack(uint32_t stackIdx, xcb_timestamp_t time) -> bool;
+auto MoveActiveToStack(uint32_t stackIdx, xcb_timestamp_t time) -> bool;
+
 } // namespace nyla
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include "nyla/apps/wm/wm_commands.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "nyla/platform/x11/platform_x11.h"
+#include "xcb/xcb.h"
+#include "xcb/xcbext.h"
+#include "xcb/xproto.h"
+
+namespace nyla
+{
+
+using namespace platform_x11_internal;
+
+WMCommandQueue wmCommands;
+void (*wmCommandSink)(std::span<const WMCommand> commands) = WMCommandsSendX11;
+
+static void Queue(const WMCommand &command)
+{
+    wmCommands.commands.emplace_back(command);
+    ++wmCommands.stats.queued;
+}
+
+static void QueueBarrier(const WMCommand &command)
+{
+    Queue(command);
+    wmCommands.barrier = wmCommands.commands.size();
+}
+
+static void Supersede(uint32_t idx)
+{
+    wmCommands.commands[idx].type = WMCommandType::KSuperseded;
+    ++wmCommands.stats.superseded;
+}
+
+// Only the last of several requests that set the same state is kept, unless a barrier sits between them.
+static void QueueReplacing(const WMCommand &command, uint32_t key)
+{
+    const auto [it, inserted] =
+        wmCommands.pendingReplacements.try_emplace({command.type, command.window, key}, wmCommands.commands.size());
+    if (!inserted)
+    {
+        if (it->second >= wmCommands.barrier)
+            Supersede(it->second);
+        it->second = wmCommands.commands.size();
+    }
+    Queue(command);
+}
+
+void WMCreateWindow(xcb_window_t window, xcb_window_t parent, uint16_t windowClass, int16_t x, int16_t y,
+                    uint16_t width, uint16_t height, uint32_t eventMask)
+{
+    Queue({
+        .type = WMCommandType::KCreateWindow,
+        .window = window,
+        .arg0 = parent,
+        .arg1 = windowClass,
+        .values = {static_cast<uint32_t>(x), static_cast<uint32_t>(y), width, height, eventMask},
+    });
+}
+
+void WMConfigureWindow(xcb_window_t window, uint16_t mask, const std::array<uint32_t, kWMConfigureValueCount> &values)
+{
+    CHECK_LT(mask, 1 << kWMConfigureValueCount);
+
+    WMCommand command{.type = WMCommandType::KConfigureWindow, .mask = mask, .window = window, .values = values};
+
+    // The pending configure is folded into this one, values set by both take the newer one.
+    const auto [it, inserted] = wmCommands.pendingConfigures.try_emplace(window, wmCommands.commands.size());
+    if (!inserted)
+    {
+        if (it->second >= wmCommands.barrier)
+        {
+            const WMCommand &pending = wmCommands.commands[it->second];
+            for (uint32_t bit = 0; bit < kWMConfigureValueCount; ++bit)
+            {
+                if ((pending.mask & (1 << bit)) && !(mask & (1 << bit)))
+                    command.values[bit] = pending.values[bit];
+            }
+            command.mask |= pending.mask;
+
+            Supersede(it->second);
+        }
+        it->second = wmCommands.commands.size();
+    }
+
+    Queue(command);
+}
+
+void WMMapWindow(xcb_window_t window)
+{
+    QueueBarrier({.type = WMCommandType::KMapWindow, .window = window});
+}
+
+void WMUnmapWindow(xcb_window_t window)
+{
+    QueueBarrier({.type = WMCommandType::KUnmapWindow, .window = window});
+}
+
+void WMReparentWindow(xcb_window_t window, xcb_window_t parent, int16_t x, int16_t y)
+{
+    QueueBarrier({
+        .type = WMCommandType::KReparentWindow,
+        .window = window,
+        .arg0 = parent,
+        .values = {static_cast<uint32_t>(x), static_cast<uint32_t>(y)},
+    });
+}
+
+void WMChangeWindowAttribute(xcb_window_t window, uint32_t mask, uint32_t value)
+{
+    CHECK_EQ(std::popcount(mask), 1);
+    QueueReplacing({.type = WMCommandType::KChangeWindowAttribute, .window = window, .arg0 = mask, .values = {value}},
+                   mask);
+}
+
+void WMChangeSaveSet(xcb_window_t window, xcb_set_mode_t mode)
+{
+    Queue({.type = WMCommandType::KChangeSaveSet, .window = window, .arg0 = mode});
+}
+
+void WMSetInputFocus(xcb_window_t window, xcb_timestamp_t time)
+{
+    // Keyed without the window, only the last focus change of a batch matters.
+    QueueReplacing({.type = WMCommandType::KSetInputFocus, .window = 0, .arg0 = window, .arg1 = time}, 0);
+}
+
+void WMChangeProperty(xcb_window_t window, xcb_atom_t property, xcb_atom_t type, std::span<const uint32_t> values)
+{
+    CHECK_LE(values.size(), std::numeric_limits<uint8_t>::max());
+
+    WMCommand command{
+        .type = WMCommandType::KChangeProperty,
+        .valueCount = static_cast<uint8_t>(values.size()),
+        .window = window,
+        .arg0 = property,
+        .arg1 = type,
+    };
+    if (values.size() <= kWMInlinePropertyValueCount)
+    {
+        std::ranges::copy(values, command.values.begin());
+    }
+    else
+    {
+        command.values[0] = wmCommands.propertyValues.size();
+        wmCommands.propertyValues.insert(wmCommands.propertyValues.end(), values.begin(), values.end());
+    }
+    QueueReplacing(command, property);
+}
+
+void WMDeleteProperty(xcb_window_t window, xcb_atom_t property)
+{
+    QueueReplacing({.type = WMCommandType::KDeleteProperty, .window = window, .arg0 = property}, property);
+}
+
+void WMSendTakeFocus(xcb_window_t window, xcb_timestamp_t time)
+{
+    Queue({.type = WMCommandType::KSendTakeFocus, .window = window, .arg0 = time});
+}
+
+void WMSendDeleteWindow(xcb_window_t window)
+{
+    Queue({.type = WMCommandType::KSendDeleteWindow, .window = window});
+}
+
+void WMSendConfigureNotify(xcb_window_t window, xcb_window_t parent, int16_t x, int16_t y, uint16_t width,
+                           uint16_t height, uint16_t borderWidth)
+{
+    Queue({
+        .type = WMCommandType::KSendConfigureNotify,
+        .window = window,
+        .arg0 = parent,
+        .values = {static_cast<uint32_t>(x), static_cast<uint32_t>(y), width, height, borderWidth},
+    });
+}
+
+void WMSelectRawMotion(bool enable)
+{
+    QueueReplacing({.type = WMCommandType::KSelectRawMotion, .arg0 = enable}, 0);
+}
+
+void WMCommandsSendX11(std::span<const WMCommand> commands)
+{
+    for (const WMCommand &command : commands)
+    {
+        switch (command.type)
+        {
+        case WMCommandType::KSuperseded:
+            break;
+
+        case WMCommandType::KCreateWindow:
+            xcb_create_window(x11.conn, XCB_COPY_FROM_PARENT, command.window, command.arg0,
+                              static_cast<int16_t>(command.values[0]), static_cast<int16_t>(command.values[1]),
+                              command.values[2], command.values[3], 0, command.arg1, XCB_COPY_FROM_PARENT,
+                              XCB_CW_OVERRIDE_REDIRECT | XCB_CW_EVENT_MASK, (uint32_t[]){true, command.values[4]});
+            break;
+
+        case WMCommandType::KConfigureWindow: {
+            std::array<uint32_t, kWMConfigureValueCount> values;
+            uint32_t count = 0;
+            for (uint32_t bit = 0; bit < kWMConfigureValueCount; ++bit)
+            {
+                if (command.mask & (1 << bit))
+                    values[count++] = command.values[bit];
+            }
+            xcb_configure_window(x11.conn, command.window, command.mask, values.data());
+            break;
+        }
+
+        case WMCommandType::KMapWindow:
+            xcb_map_window(x11.conn, command.window);
+            break;
+
+        case WMCommandType::KUnmapWindow:
+            xcb_unmap_window(x11.conn, command.window);
+            break;
+
+        case WMCommandType::KReparentWindow:
+            xcb_reparent_window(x11.conn, command.window, command.arg0, static_cast<int16_t>(command.values[0]),
+                                static_cast<int16_t>(command.values[1]));
+            break;
+
+        case WMCommandType::KChangeWindowAttribute:
+            xcb_change_window_attributes(x11.conn, command.window, command.arg0, command.values.data());
+            break;
+
+        case WMCommandType::KChangeSaveSet:
+            xcb_change_save_set(x11.conn, command.arg0, command.window);
+            break;
+
+        case WMCommandType::KSetInputFocus:
+            xcb_set_input_focus(x11.conn, XCB_INPUT_FOCUS_NONE, command.arg0, command.arg1);
+            break;
+
+        case WMCommandType::KChangeProperty: {
+            const uint32_t *values = command.valueCount <= kWMInlinePropertyValueCount
+                                         ? command.values.data()
+                                         : wmCommands.propertyValues.data() + command.values[0];
+            xcb_change_property(x11.conn, XCB_PROP_MODE_REPLACE, command.window, command.arg0, command.arg1, 32,
+                                command.valueCount, values);
+            break;
+        }
+
+        case WMCommandType::KDeleteProperty:
+            xcb_delete_property(x11.conn, command.window, command.arg0);
+            break;
+
+        case WMCommandType::KSendTakeFocus:
+            X11SendWmTakeFocus(command.window, command.arg0);
+            break;
+
+        case WMCommandType::KSendDeleteWindow:
+            X11SendWmDeleteWindow(command.window);
+            break;
+
+        case WMCommandType::KSendConfigureNotify:
+            X11SendConfigureNotify(command.window, command.arg0, static_cast<int16_t>(command.values[0]),
+                                   static_cast<int16_t>(command.values[1]), command.values[2], command.values[3],
+                                   command.values[4]);
+            break;
+
+        case WMCommandType::KSelectRawMotion:
+            xcb_discard_reply(x11.conn, X11SelectRawMotion(command.arg0).sequence);
+            break;
+        }
+    }
+
+    xcb_flush(x11.conn);
+}
+
+void WMCommandsFlush()
+{
+    wmCommands.stats.sent += wmCommands.commands.size();
+    wmCommands.stats.sent -= std::ranges::count(wmCommands.commands, WMCommandType::KSuperseded, &WMCommand::type);
+    ++wmCommands.stats.flushes;
+
+    wmCommandSink(wmCommands.commands);
+
+    wmCommands.commands.clear();
+    wmCommands.propertyValues.clear();
+    wmCommands.pendingConfigures.clear();
+    wmCommands.pendingReplacements.clear();
+    wmCommands.barrier = 0;
+}
+
+static auto X11PollForEvent(bool queuedOnly) -> xcb_generic_event_t *
+{
+    return queuedOnly ? xcb_poll_for_queued_event(x11.conn) : xcb_poll_for_event(x11.conn);
+}
+
+static auto X11GenerateId() -> xcb_window_t
+{
+    return xcb_generate_id(x11.conn);
+}
+
+static void X11SelectEvents(xcb_window_t window, uint32_t eventMask)
+{
+    xcb_change_window_attributes(x11.conn, window, XCB_CW_EVENT_MASK, &eventMask);
+}
+
+static auto X11RequestProperty(xcb_window_t window, xcb_atom_t property, uint32_t longLength) -> uint32_t
+{
+    return xcb_get_property_unchecked(x11.conn, false, window, property, XCB_ATOM_ANY, 0, longLength).sequence;
+}
+
+static auto X11PollForProperty(uint32_t sequence, xcb_window_t window, xcb_atom_t property,
+                               xcb_get_property_reply_t **reply) -> bool
+{
+    void *polled = nullptr;
+    xcb_generic_error_t *error = nullptr;
+    if (!xcb_poll_for_reply(x11.conn, sequence, &polled, &error))
+        return false;
+
+    free(error);
+    *reply = static_cast<xcb_get_property_reply_t *>(polled);
+    return true;
+}
+
+static void X11DiscardProperty(uint32_t sequence)
+{
+    xcb_discard_reply(x11.conn, sequence);
+}
+
+WMServerSource wmServerSource = {
+    .pollForEvent = X11PollForEvent,
+    .generateId = X11GenerateId,
+    .queryMonitors = X11QueryMonitors,
+    .selectEvents = X11SelectEvents,
+    .requestProperty = X11RequestProperty,
+    .pollForProperty = X11PollForProperty,
+    .discardProperty = X11DiscardProperty,
+};
+
+} // namespace nyla
\ No newline at end of file
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include "nyla/commons/containers/map.h"
+#include "nyla/platform/x11/platform_x11.h"
+#include "xcb/xcb.h"
+#include "xcb/xproto.h"
+
+namespace nyla
+{
+
+// The WM core queues its requests to the server here instead of issuing them through xcb directly. The queue is
+// handed to wmCommandSink once per iteration, requests made redundant by a later one in the same batch are dropped
+// before that. Map, unmap and reparent requests are barriers: requests before one are never dropped in favour of a
+// request after it, since moving the state change across the barrier could reorder it against what it depends on.
+
+enum class WMCommandType : uint8_t
+{
+    KSuperseded,
+    KCreateWindow,
+    KConfigureWindow,
+    KMapWindow,
+    KUnmapWindow,
+    KReparentWindow,
+    KChangeWindowAttribute,
+    KChangeSaveSet,
+    KSetInputFocus,
+    KChangeProperty,
+    KDeleteProperty,
+    KSendTakeFocus,
+    KSendDeleteWindow,
+    KSendConfigureNotify,
+    KSelectRawMotion,
+};
+
+// Configure values are indexed by bit position in the mask, only the geometry and border width bits are supported.
+inline constexpr uint32_t kWMConfigureValueCount = 5;
+
+// Property values longer than the inline values go to WMCommandQueue::propertyValues, values[0] is their offset there.
+inline constexpr uint32_t kWMInlinePropertyValueCount = kWMConfigureValueCount;
+
+struct WMCommand
+{
+    WMCommandType type;
+    uint8_t valueCount;
+    uint16_t mask;
+    xcb_window_t window;
+    uint32_t arg0;
+    uint32_t arg1;
+    std::array<uint32_t, kWMConfigureValueCount> values;
+};
+
+struct WMCommandQueue
+{
+    std::vector<WMCommand> commands;
+    std::vector<uint32_t> propertyValues;
+    Map<xcb_window_t, uint32_t> pendingConfigures;
+    Map<std::tuple<WMCommandType, xcb_window_t, uint32_t>, uint32_t> pendingReplacements;
+    uint32_t barrier;
+
+    struct
+    {
+        uint64_t queued;
+        uint64_t superseded;
+        uint64_t sent;
+        uint64_t flushes;
+    } stats;
+};
+extern WMCommandQueue wmCommands;
+
+// Defaults to WMCommandsSendX11, benchmarks can swap it out to run the core without a server.
+extern void (*wmCommandSink)(std::span<const WMCommand> commands);
+
+// What the core reads from the server goes through wmServerSource: events, property replies, monitors and the ids of
+// the windows it creates. Property requests are sent as they are made instead of being queued, so they bypass
+// wmCommandSink, and so does the client event mask that has to reach the server ahead of them. Defaults to xcb,
+// wm_replay serves everything from a capture and runs without a server.
+struct WMServerSource
+{
+    auto (*pollForEvent)(bool queuedOnly) -> xcb_generic_event_t *;
+    auto (*generateId)() -> xcb_window_t;
+    auto (*queryMonitors)() -> std::vector<platform_x11_internal::X11Monitor>;
+    void (*selectEvents)(xcb_window_t window, uint32_t eventMask);
+
+    // The returned sequence identifies the request to pollForProperty and discardProperty. pollForProperty returns
+    // false while the reply is not available yet, the reply is freed by the caller.
+    auto (*requestProperty)(xcb_window_t window, xcb_atom_t property, uint32_t longLength) -> uint32_t;
+    auto (*pollForProperty)(uint32_t sequence, xcb_window_t window, xcb_atom_t property,
+                            xcb_get_property_reply_t **reply) -> bool;
+    void (*discardProperty)(uint32_t sequence);
+};
+extern WMServerSource wmServerSource;
+
+void WMCommandsSendX11(std::span<const WMCommand> commands);
+void WMCommandsFlush();
+
+// Override-redirect, with the parent's visual and no background.
+void WMCreateWindow(xcb_window_t window, xcb_window_t parent, uint16_t windowClass, int16_t x, int16_t y,
+                    uint16_t width, uint16_t height, uint32_t eventMask);
+void WMConfigureWindow(xcb_window_t window, uint16_t mask, const std::array<uint32_t, kWMConfigureValueCount> &values);
+void WMMapWindow(xcb_window_t window);
+void WMUnmapWindow(xcb_window_t window);
+void WMReparentWindow(xcb_window_t window, xcb_window_t parent, int16_t x, int16_t y);
+void WMChangeWindowAttribute(xcb_window_t window, uint32_t mask, uint32_t value);
+void WMChangeSaveSet(xcb_window_t window, xcb_set_mode_t mode);
+void WMSetInputFocus(xcb_window_t window, xcb_timestamp_t time);
+void WMChangeProperty(xcb_window_t window, xcb_atom_t property, xcb_atom_t type, std::span<const uint32_t> values);
+void WMDeleteProperty(xcb_window_t window, xcb_atom_t property);
+void WMSendTakeFocus(xcb_window_t window, xcb_timestamp_t time);
+void WMSendDeleteWindow(xcb_window_t window);
+void WMSendConfigureNotify(xcb_window_t window, xcb_window_t parent, int16_t x, int16_t y, uint16_t width,
+                           uint16_t height, uint16_t borderWidth);
+void WMSelectRawMotion(bool enable);
+
+} // namespace nyla
\ No newline at end of file
@@ -0,0 +1,334 @@
+#include "nyla/apps/wm/wm_dbus.h"
+
+#include <cstdarg>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "nyla/apps/wm/window_manager.h"
+#include "nyla/commons/os/clock.h"
+#include "nyla/commons/os/timerfd.h"
+#include "nyla/dbus/dbus.h"
+#include "xcb/xproto.h"
+
+namespace nyla
+{
+
+static constexpr const char *kInterface = "org.nyla.WindowManager";
+static constexpr const char *kPath = "/org/nyla/WindowManager";
+
+// Signals go out at most once per frame, a burst of changes in between collapses into the last state.
+static constexpr uint64_t kSignalIntervalMillis = 16;
+
+static struct
+{
+    xcb_window_t window;
+    uint32_t outputIdx;
+    uint32_t stackIdx;
+    std::string title;
+
+    uint64_t lastEmitMillis;
+    uint64_t timer;
+} signalState;
+
+static const bool *wmIsRunning;
+static const KeybindTable *wmKeybinds;
+
+// Titles come straight from WM_NAME, libdbus aborts on strings that are not UTF-8.
+static auto SanitizeTitle(std::string_view title) -> std::string
+{
+    std::string out{title};
+    if (dbus_validate_utf8(out.c_str(), nullptr))
+        return out;
+
+    std::erase_if(out, [](char ch) -> bool { return ch < 0x20 || ch > 0x7E; });
+    return out;
+}
+
+static void EmitSignal(const char *member, int firstType, ...)
+{
+    DBusMessage *signal = dbus_message_new_signal(kPath, kInterface, member);
+    if (!signal)
+        return;
+
+    va_list args;
+    va_start(args, firstType);
+    const bool ok = dbus_message_append_args_valist(signal, firstType, args);
+    va_end(args);
+
+    if (ok)
+        dbus_connection_send(dbus.conn, signal, nullptr);
+    dbus_message_unref(signal);
+}
+
+static void EmitSignals()
+{
+    signalState.lastEmitMillis = GetMonotonicTimeMillis();
+
+    const WMActiveState state = WMGetActiveState();
+
+    if (state.outputIdx != signalState.outputIdx || state.stackIdx != signalState.stackIdx)
+    {
+        signalState.outputIdx = state.outputIdx;
+        signalState.stackIdx = state.stackIdx;
+        EmitSignal("StackChanged",                           //
+                   DBUS_TYPE_UINT32, &signalState.outputIdx, //
+                   DBUS_TYPE_UINT32, &signalState.stackIdx,  //
+                   DBUS_TYPE_INVALID);
+    }
+
+    const bool focusChanged = state.window != signalState.window;
+    if (!focusChanged && state.title == signalState.title)
+        return;
+
+    signalState.window = state.window;
+    signalState.title = state.title;
+
+    const std::string title = SanitizeTitle(state.title);
+    const char *titlePtr = title.c_str();
+    EmitSignal(focusChanged ? "FocusChanged" : "TitleChanged", //
+               DBUS_TYPE_UINT32, &signalState.window,          //
+               DBUS_TYPE_STRING, &titlePtr,                    //
+               DBUS_TYPE_INVALID);
+}
+
+static void HandleActiveStateChange(const WMActiveState &state)
+{
+    if (!dbus.conn || signalState.timer)
+        return;
+
+    const uint64_t sinceEmitMillis = GetMonotonicTimeMillis() - signalState.lastEmitMillis;
+    if (sinceEmitMillis >= kSignalIntervalMillis)
+    {
+        EmitSignals();
+        return;
+    }
+
+    signalState.timer = TimerAdd(
+        kSignalIntervalMillis - sinceEmitMillis, 0, 0,
+        [](void *data) -> void {
+            signalState.timer = 0;
+            EmitSignals();
+        },
+        nullptr);
+}
+
+static constexpr struct
+{
+    const char *member;
+    void (*handler)(xcb_timestamp_t time);
+} kTimedActions[] = {
+    {"NextStack", MoveStackNext},
+    {"PrevStack", MoveStackPrev},
+    {"NextWindow", MoveLocalNext},
+    {"PrevWindow", MoveLocalPrev},
+};
+
+static constexpr struct
+{
+    const char *member;
+    void (*handler)();
+} kActions[] = {
+    {"CloseActive", CloseActive},
+    {"ToggleZoom", ToggleZoom},
+    {"ToggleFollow", ToggleFollow},
+    {"NextLayout", NextLayout},
+};
+
+static constexpr struct
+{
+    const char *member;
+    auto (*handler)(uint32_t stackIdx, xcb_timestamp_t time) -> bool;
+} kStackActions[] = {
+    {"SwitchStack", SwitchToStack},
+    {"MoveToStack", MoveActiveToStack},
+};
+
+// Method calls arrive outside of the X event handler, so the WM is brought up to date here.
+static void ApplyToWM()
+{
+    RunWM(*wmIsRunning, *wmKeybinds);
+}
+
+static void ReplyUnknownWindow(DBusMessage *msg, uint32_t window)
+{
+    DBusErrorWrapper err;
+    dbus_set_error(err, DBUS_ERROR_INVALID_ARGS, "window %u is not managed", window);
+    DBusReplyInvalidArguments(msg, err);
+}
+
+static void HandleMessage(DBusMessage *msg)
+{
+    for (auto [member, handler] : kTimedActions)
+    {
+        if (dbus_message_is_method_call(msg, kInterface, member))
+        {
+            handler(XCB_CURRENT_TIME);
+            ApplyToWM();
+            DBusReplyNone(msg);
+            return;
+        }
+    }
+
+    for (auto [member, handler] : kActions)
+    {
+        if (dbus_message_is_method_call(msg, kInterface, member))
+        {
+            handler();
+            ApplyToWM();
+            DBusReplyNone(msg);
+            return;
+        }
+    }
+
+    if (dbus_message_is_method_call(msg, kInterface, "Focus"))
+    {
+        uint32_t inWindow;
+
+        DBusErrorWrapper err;
+        if (!dbus_message_get_args(msg, err,                    //
+                                   DBUS_TYPE_UINT32, &inWindow, //
+                                   DBUS_TYPE_INVALID))
+        {
+            DBusReplyInvalidArguments(msg, err);
+            return;
+        }
+
+        if (!FocusWindow(inWindow, XCB_CURRENT_TIME))
+        {
+            ReplyUnknownWindow(msg, inWindow);
+            return;
+        }
+
+        ApplyToWM();
+        DBusReplyNone(msg);
+        return;
+    }
+
+    for (auto [member, handler] : kStackActions)
+    {
+        if (dbus_message_is_method_call(msg, kInterface, member))
+        {
+            uint32_t inStack;
+
+            DBusErrorWrapper err;
+            if (!dbus_message_get_args(msg, err,                   //
+                                       DBUS_TYPE_UINT32, &inStack, //
+                                       DBUS_TYPE_INVALID))
+            {
+                DBusReplyInvalidArguments(msg, err);
+                return;
+            }
+
+            if (!handler(inStack, XCB_CURRENT_TIME))
+            {
+                dbus_set_error(err, DBUS_ERROR_INVALID_ARGS, "stack %u is out of range", inStack);
+                DBusReplyInvalidArguments(msg, err);
+                return;
+            }
+
+            ApplyToWM();
+            DBusReplyNone(msg);
+            return;
+        }
+    }
+
+    if (dbus_message_is_method_call(msg, kInterface, "GetActive"))
+    {
+        const WMActiveState state = WMGetActiveState();
+        const std::string title = SanitizeTitle(state.title);
+        const char *titlePtr = title.c_str();
+
+        DBusMessage *reply = dbus_message_new_method_return(msg);
+        if (!reply)
+            return;
+
+        dbus_message_append_args(reply,                            //
+                                 DBUS_TYPE_UINT32, &state.window,    //
+                                 DBUS_TYPE_UINT32, &state.outputIdx, //
+                                 DBUS_TYPE_UINT32, &state.stackIdx,  //
+                                 DBUS_TYPE_STRING, &titlePtr,        //
+                                 DBUS_TYPE_INVALID);
+        dbus_connection_send(dbus.conn, reply, nullptr);
+        dbus_message_unref(reply);
+        return;
+    }
+
+    if (dbus_message_get_type(msg) == DBUS_MESSAGE_TYPE_METHOD_CALL)
+    {
+        DBusMessage *reply = dbus_message_new_error(msg, DBUS_ERROR_UNKNOWN_METHOD, dbus_message_get_member(msg));
+        if (!reply)
+            return;
+        dbus_connection_send(dbus.conn, reply, nullptr);
+        dbus_message_unref(reply);
+    }
+}
+
+void WMDBusInit(const bool &isRunning, const KeybindTable &keybinds)
+{
+    if (!dbus.conn)
+        return;
+
+    wmIsRunning = &isRunning;
+    wmKeybinds = &keybinds;
+
+    auto handler = new DBusObjectPathHandler{
+        .introspectXml = "<node>"
+                         " <interface name='org.nyla.WindowManager'>"
+                         "  <method name='Focus'>"
+                         "   <arg name='window' type='u' direction='in'/>"
+                         "  </method>"
+                         "  <method name='SwitchStack'>"
+                         "   <arg name='stack' type='u' direction='in'/>"
+                         "  </method>"
+                         "  <method name='MoveToStack'>"
+                         "   <arg name='stack' type='u' direction='in'/>"
+                         "  </method>"
+                         "  <method name='NextStack'/>"
+                         "  <method name='PrevStack'/>"
+                         "  <method name='NextWindow'/>"
+                         "  <method name='PrevWindow'/>"
+                         "  <method name='CloseActive'/>"
+                         "  <method name='ToggleZoom'/>"
+                         "  <method name='ToggleFollow'/>"
+                         "  <method name='NextLayout'/>"
+                         "  <method name='GetActive'>"
+                         "   <arg name='window' type='u' direction='out'/>"
+                         "   <arg name='output' type='u' direction='out'/>"
+                         "   <arg name='stack' type='u' direction='out'/>"
+                         "   <arg name='title' type='s' direction='out'/>"
+                         "  </method>"
+                         "  <signal name='FocusChanged'>"
+                         "   <arg name='window' type='u'/>"
+                         "   <arg name='title' type='s'/>"
+                         "  </signal>"
+                         "  <signal name='TitleChanged'>"
+                         "   <arg name='window' type='u'/>"
+                         "   <arg name='title' type='s'/>"
+                         "  </signal>"
+                         "  <signal name='StackChanged'>"
+                         "   <arg name='output' type='u'/>"
+                         "   <arg name='stack' type='u'/>"
+                         "  </signal>"
+                         " </interface>"
+                         " <interface name='org.freedesktop.DBus.Introspectable'>"
+                         "  <method name='Introspect'>"
+                         "   <arg name='xml' type='s' direction='out'/>"
+                         "  </method>"
+                         " </interface>"
+                         "</node>",
+        .messageHandler = HandleMessage,
+        .nameOwnerChangedHandler = nullptr,
+    };
+
+    DBusRegisterHandler(kInterface, kPath, handler);
+
+    const WMActiveState state = WMGetActiveState();
+    signalState.window = state.window;
+    signalState.outputIdx = state.outputIdx;
+    signalState.stackIdx = state.stackIdx;
+    signalState.title = state.title;
+    wmActiveStateObserver = HandleActiveStateChange;
+}
+
+} // namespace nyla
\ No newline at end of file
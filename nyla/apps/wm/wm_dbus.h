@@ -0,0 +1,12 @@
+#pragma once
+
+#include "nyla/apps/wm/window_manager.h"
+
+namespace nyla
+{
+
+// org.nyla.WindowManager at /org/nyla/WindowManager, must come after DBusInitialize and InitializeWM. Method calls run
+// the WM through RunWM with the given state.
+void WMDBusInit(const bool &isRunning, const KeybindTable &keybinds);
+
+} // namespace nyla
\ No newline at end of file
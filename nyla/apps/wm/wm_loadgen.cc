@@ -0,0 +1,402 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/strings/str_format.h"
+#include "nyla/commons/logging/init.h"
+#include "nyla/commons/os/clock.h"
+#include "nyla/commons/stats/latency_histogram.h"
+#include "nyla/platform/x11/platform_x11.h"
+#include "nyla/platform/x11/platform_x11_wm_hints.h"
+#include "xcb/xcb.h"
+#include "xcb/xproto.h"
+
+// Opens a set of client windows and churns them while measuring, from the client side, how long the WM takes to
+// respond to each operation. Meant to run against Xvfb with the WM under test already managing the display. Each
+// operation is acknowledged by its effect. Retitles and urgency changes have no visible one, they are acknowledged by
+// the property_stats file of the WM debugfs given with --debugfs, so nothing else may be changing properties meanwhile.
+
+namespace nyla
+{
+
+using namespace platform_x11_internal;
+
+enum class Scenario
+{
+    KMap,
+    KRetitle,
+    KUrgency,
+    KConfigure,
+    KFocus,
+};
+
+static constexpr std::pair<std::string_view, Scenario> kScenarios[] = {
+    {"map", Scenario::KMap},
+    {"retitle", Scenario::KRetitle},
+    {"urgency", Scenario::KUrgency},
+    {"configure", Scenario::KConfigure},
+    {"focus", Scenario::KFocus},
+};
+
+static struct
+{
+    uint32_t windows = 16;
+    uint32_t iterations = 1000;
+    uint32_t burst = 1;
+    uint64_t timeoutMillis = 1000;
+    std::string debugFsPath;
+    std::vector<Scenario> scenarios;
+} options;
+
+static std::vector<xcb_window_t> windows;
+static std::vector<bool> windowUrgency;
+
+// RunOperation returns this for iterations that have nothing to measure.
+static constexpr uint64_t kSkipped = UINT64_MAX;
+
+// Waits for an event accepted by match, everything else is dropped. Returns false on timeout.
+static auto WaitForEvent(uint64_t deadlineMicros, auto match) -> bool
+{
+    while (true)
+    {
+        while (xcb_generic_event_t *event = xcb_poll_for_event(x11.conn))
+        {
+            const bool matched = match(event);
+            free(event);
+            if (matched)
+                return true;
+        }
+
+        const uint64_t now = GetMonotonicTimeMicros();
+        if (now >= deadlineMicros || xcb_connection_has_error(x11.conn))
+            return false;
+
+        pollfd pfd{.fd = xcb_get_file_descriptor(x11.conn), .events = POLLIN};
+        poll(&pfd, 1, static_cast<int>((deadlineMicros - now + 999) / 1000));
+    }
+}
+
+static auto IsEvent(const xcb_generic_event_t *event, uint8_t type, xcb_window_t window) -> bool
+{
+    if ((event->response_type & 0x7F) != type)
+        return false;
+
+    // The window field sits at the same offset in all the notify events waited on here.
+    return reinterpret_cast<const xcb_map_notify_event_t *>(event)->window == window;
+}
+
+static void SetName(xcb_window_t window, std::string_view name)
+{
+    xcb_change_property(x11.conn, XCB_PROP_MODE_REPLACE, window, XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8, name.size(),
+                        name.data());
+}
+
+static void SetUrgency(xcb_window_t window, bool urgent)
+{
+    WmHints hints{};
+    hints.flags = WmHints::kInputHint | (urgent ? WmHints::kUrgencyHint : 0);
+    hints.input = true;
+    xcb_change_property(x11.conn, XCB_PROP_MODE_REPLACE, window, XCB_ATOM_WM_HINTS, XCB_ATOM_WM_HINTS, 32,
+                        sizeof(hints) / 4, &hints);
+}
+
+struct PropertyCounters
+{
+    uint64_t notified;
+    uint64_t pending;
+};
+
+// Reads the line for property from property_stats. The WM answers debugfs reads between event loop iterations, so
+// every notify it reports has been dispatched and every fetch it started is either counted as pending or handled.
+static auto ReadPropertyCounters(std::string_view property) -> PropertyCounters
+{
+    const std::string path = options.debugFsPath + "/property_stats";
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        PLOG(QFATAL) << "open " << path;
+
+    char buf[4096];
+    const ssize_t size = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (size < 0)
+        PLOG(QFATAL) << "read " << path;
+    buf[size] = '\0';
+
+    const std::string prefix = absl::StrFormat("%s: ", property);
+    for (const char *line = buf; *line;)
+    {
+        PropertyCounters counters;
+        if (std::string_view{line}.starts_with(prefix) &&
+            std::sscanf(line + prefix.size(),
+                        "notified %" SCNu64 " coalesced %*u deferred %*u fetched %*u handled %*u pending %" SCNu64,
+                        &counters.notified, &counters.pending) == 2)
+            return counters;
+
+        const char *next = std::strchr(line, '\n');
+        if (!next)
+            break;
+        line = next + 1;
+    }
+
+    LOG(QFATAL) << "no " << property << " in " << path;
+    return {};
+}
+
+// Waits until the WM has taken notifies for property up to target and has no fetch of it in flight, at which point
+// the last value set has been handled or, for lazily fetched properties, marked stale. Returns false on timeout.
+static auto WaitForProperty(uint64_t deadlineMicros, std::string_view property, uint64_t target) -> bool
+{
+    while (true)
+    {
+        const PropertyCounters counters = ReadPropertyCounters(property);
+        if (counters.notified >= target && !counters.pending)
+            return true;
+
+        if (GetMonotonicTimeMicros() >= deadlineMicros)
+            return false;
+    }
+}
+
+// The WM answers a configure request with a synthetic ConfigureNotify once it has processed every event before it.
+static void RequestConfigure(xcb_window_t window, uint32_t width)
+{
+    xcb_configure_window(x11.conn, window, XCB_CONFIG_WINDOW_WIDTH, (uint32_t[]){width});
+}
+
+static auto IsConfigureAck(const xcb_generic_event_t *event, xcb_window_t window) -> bool
+{
+    return (event->response_type & 0x80) && IsEvent(event, XCB_CONFIGURE_NOTIFY, window);
+}
+
+// Returns the response time in microseconds, 0 if the WM did not respond in time or kSkipped.
+static auto RunOperation(Scenario scenario, uint32_t iteration) -> uint64_t
+{
+    xcb_window_t window = windows[iteration % windows.size()];
+
+    switch (scenario)
+    {
+    case Scenario::KMap: {
+        xcb_unmap_window(x11.conn, window);
+        xcb_flush(x11.conn);
+        WaitForEvent(GetMonotonicTimeMicros() + options.timeoutMillis * 1000, [window](auto *event) -> bool {
+            return IsEvent(event, XCB_UNMAP_NOTIFY, window);
+        });
+        break;
+    }
+
+    case Scenario::KFocus: {
+        xcb_get_input_focus_reply_t *reply =
+            xcb_get_input_focus_reply(x11.conn, xcb_get_input_focus(x11.conn), nullptr);
+        const xcb_window_t focused = reply ? reply->focus : XCB_NONE;
+        free(reply);
+
+        // Stealing focus from ourselves is a no-op the WM never sees.
+        if (focused == window)
+            window = windows[(iteration + 1) % windows.size()];
+        if (focused == window)
+            return kSkipped;
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    // Taken before the clock starts, the reads themselves go through the WM loop.
+    uint64_t notifiedBefore = 0;
+    if (scenario == Scenario::KRetitle || scenario == Scenario::KUrgency)
+        notifiedBefore = ReadPropertyCounters(scenario == Scenario::KRetitle ? "WM_NAME" : "WM_HINTS").notified;
+
+    const uint64_t start = GetMonotonicTimeMicros();
+    const uint64_t deadline = start + options.timeoutMillis * 1000;
+    bool responded = false;
+
+    switch (scenario)
+    {
+    case Scenario::KMap: {
+        xcb_map_window(x11.conn, window);
+        xcb_flush(x11.conn);
+        responded = WaitForEvent(deadline, [window](auto *event) -> bool {
+            return IsEvent(event, XCB_MAP_NOTIFY, window);
+        });
+        break;
+    }
+
+    case Scenario::KRetitle: {
+        std::string name;
+        for (uint32_t i = 0; i < options.burst; ++i)
+        {
+            name = absl::StrFormat("wm_loadgen retitle %v", iteration * options.burst + i);
+            SetName(window, name);
+        }
+        xcb_flush(x11.conn);
+        responded = WaitForProperty(deadline, "WM_NAME", notifiedBefore + options.burst);
+        break;
+    }
+
+    case Scenario::KUrgency: {
+        // The burst ends on the opposite of the current state, so every iteration changes what the WM tracks.
+        const uint32_t windowIdx = iteration % windows.size();
+        const bool urgent = !windowUrgency[windowIdx];
+        windowUrgency[windowIdx] = urgent;
+        for (uint32_t i = 0; i < options.burst; ++i)
+            SetUrgency(window, (options.burst - 1 - i) % 2 == 0 ? urgent : !urgent);
+        xcb_flush(x11.conn);
+        responded = WaitForProperty(deadline, "WM_HINTS", notifiedBefore + options.burst);
+        break;
+    }
+
+    case Scenario::KConfigure: {
+        RequestConfigure(window, 100 + iteration % 2);
+        xcb_flush(x11.conn);
+        responded = WaitForEvent(deadline, [window](auto *event) -> bool { return IsConfigureAck(event, window); });
+        break;
+    }
+
+    case Scenario::KFocus: {
+        xcb_set_input_focus(x11.conn, XCB_INPUT_FOCUS_POINTER_ROOT, window, XCB_CURRENT_TIME);
+        xcb_flush(x11.conn);
+
+        // The WM takes focus back from windows that are not active.
+        responded = WaitForEvent(deadline, [window](auto *event) -> bool {
+            return (event->response_type & 0x7F) == XCB_FOCUS_OUT &&
+                   reinterpret_cast<const xcb_focus_out_event_t *>(event)->event == window;
+        });
+        break;
+    }
+    }
+
+    return responded ? std::max<uint64_t>(1, GetMonotonicTimeMicros() - start) : 0;
+}
+
+static auto ParseNumber(std::string_view arg, std::string_view prefix, auto &value) -> bool
+{
+    if (!arg.starts_with(prefix))
+        return false;
+
+    std::string_view number = arg.substr(prefix.size());
+    auto [end, ec] = std::from_chars(number.data(), number.data() + number.size(), value);
+    if (ec != std::errc{} || end != number.data() + number.size())
+        LOG(QFATAL) << "invalid " << arg;
+    return true;
+}
+
+auto Main(int argc, char **argv) -> int
+{
+    LoggingInit();
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if (ParseNumber(arg, "--windows=", options.windows) || ParseNumber(arg, "--iterations=", options.iterations) ||
+            ParseNumber(arg, "--burst=", options.burst) || ParseNumber(arg, "--timeout-ms=", options.timeoutMillis))
+            continue;
+
+        if (arg.starts_with("--debugfs="))
+        {
+            options.debugFsPath = arg.substr(std::string_view{"--debugfs="}.size());
+            continue;
+        }
+
+        if (arg.starts_with("--scenario="))
+        {
+            std::string_view name = arg.substr(std::string_view{"--scenario="}.size());
+            auto it = std::ranges::find(kScenarios, name, &std::pair<std::string_view, Scenario>::first);
+            if (it == std::end(kScenarios))
+                LOG(QFATAL) << "unknown scenario " << name;
+            options.scenarios.emplace_back(it->second);
+            continue;
+        }
+
+        LOG(QFATAL) << "unknown argument " << arg;
+    }
+
+    if (!options.windows || !options.burst)
+        LOG(QFATAL) << "--windows and --burst must be positive";
+
+    if (options.scenarios.empty())
+    {
+        for (auto [_, scenario] : kScenarios)
+            options.scenarios.emplace_back(scenario);
+    }
+
+    if (options.debugFsPath.empty() &&
+        std::ranges::any_of(options.scenarios, [](Scenario scenario) -> bool {
+            return scenario == Scenario::KRetitle || scenario == Scenario::KUrgency;
+        }))
+        LOG(QFATAL) << "the retitle and urgency scenarios need --debugfs, the debugfs mount of the WM";
+
+    X11Initialize(false, false);
+
+    for (uint32_t i = 0; i < options.windows; ++i)
+    {
+        const auto eventMask = static_cast<xcb_event_mask_t>(
+            XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_FOCUS_CHANGE);
+        const xcb_window_t window = X11CreateWindow(200, 200, false, eventMask);
+        SetName(window, absl::StrFormat("wm_loadgen %v", i));
+        windows.emplace_back(window);
+    }
+    windowUrgency.assign(windows.size(), false);
+    xcb_flush(x11.conn);
+
+    uint32_t mapped = 0;
+    WaitForEvent(GetMonotonicTimeMicros() + options.timeoutMillis * 1000 * options.windows,
+                 [&mapped](auto *event) -> bool {
+                     return (event->response_type & 0x7F) == XCB_MAP_NOTIFY && ++mapped == options.windows;
+                 });
+    if (mapped != options.windows)
+        LOG(QFATAL) << "only " << mapped << " of " << options.windows << " windows were mapped, is a WM running?";
+
+    // One JSON object per scenario, latencies in microseconds.
+    for (Scenario scenario : options.scenarios)
+    {
+        static LatencyHistogram histogram;
+        LatencyHistogramReset(histogram);
+        uint32_t timeouts = 0;
+
+        const uint64_t start = GetMonotonicTimeMicros();
+        for (uint32_t iteration = 0; iteration < options.iterations; ++iteration)
+        {
+            const uint64_t micros = RunOperation(scenario, iteration);
+            if (micros == kSkipped)
+                continue;
+            if (micros)
+                LatencyHistogramRecord(histogram, micros);
+            else
+                ++timeouts;
+        }
+        const double seconds = (GetMonotonicTimeMicros() - start) / 1e6;
+
+        const std::string_view name =
+            std::ranges::find(kScenarios, scenario, &std::pair<std::string_view, Scenario>::second)->first;
+        absl::PrintF("{\"scenario\":\"%s\",\"windows\":%v,\"ops\":%v,\"timeouts\":%v,\"ops_per_second\":%.1f,"
+                     "\"p50_us\":%v,\"p99_us\":%v,\"p999_us\":%v,\"max_us\":%v}\n",
+                     name, options.windows, histogram.total, timeouts, histogram.total / seconds,
+                     LatencyHistogramQuantile(histogram, 0.5), LatencyHistogramQuantile(histogram, 0.99),
+                     LatencyHistogramQuantile(histogram, 0.999), histogram.max);
+    }
+
+    xcb_disconnect(x11.conn);
+    return 0;
+}
+
+} // namespace nyla
+
+auto main(int argc, char **argv) -> int
+{
+    return nyla::Main(argc, argv);
+}
\ No newline at end of file
@@ -16,6 +16,7 @@
 #include <cstdint>
 
 #include "nyla/platform/x11/platform_x11.h"
+#include "nyla/platform/x11/platform_x11_audit.h"
 #include "nyla/rhi/rhi.h"
 #include "nyla/rhi/rhi_pass.h"
 #include "nyla/rhi/rhi_texture.h"
@@ -34,6 +35,32 @@ namespace nyla
 namespace
 {
 
+// The WM keeps _NYLA_WM_GAME_MODE on the root only while a fullscreen client has the screen. It is read once at
+// startup, after that PropertyNotify on the root says whether it was set or deleted.
+auto IsWMGameModeOn() -> bool
+{
+    using namespace platform_x11_internal;
+
+    xcb_get_property_reply_t *reply = X11_BLOCKING(xcb_get_property_reply(
+        x11.conn,
+        xcb_get_property(x11.conn, false, x11.screen->root, x11.atoms.nyla_wm_game_mode, XCB_ATOM_CARDINAL, 0, 0),
+        nullptr));
+    if (!reply)
+        return false;
+
+    const bool on = reply->type != XCB_ATOM_NONE;
+    free(reply);
+    return on;
+}
+
+void HandlePropertyNotify(void *user, uint32_t window, uint32_t atom, bool deleted)
+{
+    using namespace platform_x11_internal;
+
+    if (window == x11.screen->root && atom == x11.atoms.nyla_wm_game_mode)
+        *static_cast<bool *>(user) = !deleted;
+}
+
 auto Main() -> int
 {
     using namespace platform_x11_internal;
@@ -46,6 +73,8 @@ auto Main() -> int
     const xcb_window_t window =
         X11CreateWindow(x11.screen->width_in_pixels, x11.screen->height_in_pixels, true, XCB_EVENT_MASK_EXPOSURE);
     xcb_configure_window(x11.conn, window, XCB_CONFIG_WINDOW_STACK_MODE, (uint32_t[]){XCB_STACK_MODE_BELOW});
+    xcb_change_window_attributes(x11.conn, x11.screen->root, XCB_CW_EVENT_MASK,
+                                 (uint32_t[]){XCB_EVENT_MASK_PROPERTY_CHANGE});
     X11Flush();
 
     RhiInit(RhiDesc{
@@ -54,14 +83,40 @@ auto Main() -> int
 
     DebugTextRenderer *debugTextRenderer = CreateDebugTextRenderer();
 
+    // Fetched after PropertyChange is selected on the root, so no change is missed in between.
+    bool gameMode = IsWMGameModeOn();
+    const PlatformProcessEventsCallbacks callbacks{
+        .handlePropertyNotify = HandlePropertyNotify,
+    };
+
     while (!PlatformShouldExit())
     {
+        // Nothing is drawn in game mode, the clock is redrawn right away once it ends.
+        bool resumed = false;
+        while (gameMode)
+        {
+            resumed = true;
+
+            // Events read along with replies during the last frame are already queued and would not wake the poll.
+            PlatformProcessEvents(callbacks, &gameMode);
+            if (!gameMode || PlatformShouldExit())
+                break;
+
+            pollfd fd{
+                .fd = xcb_get_file_descriptor(x11.conn),
+                .events = POLLIN,
+            };
+            poll(&fd, 1, -1);
+        }
+        if (PlatformShouldExit())
+            break;
+
         RhiCmdList cmd = RhiFrameBegin();
 
-        auto ret = PlatformProcessEvents({}, nullptr);
+        auto ret = PlatformProcessEvents(callbacks, &gameMode);
 
         static uint64_t prevUs = GetMonotonicTimeMicros();
-        if (!ret.shouldRedraw)
+        if (!ret.shouldRedraw && !resumed)
         {
             for (;;)
             {
@@ -82,8 +137,8 @@ auto Main() -> int
                 LOG(INFO) << pollRes;
                 if (pollRes > 0)
                 {
-                    auto ret = PlatformProcessEvents({}, nullptr);
-                    if (ret.shouldRedraw)
+                    auto ret = PlatformProcessEvents(callbacks, &gameMode);
+                    if (ret.shouldRedraw || gameMode)
                         break;
                 }
                 continue;
@@ -0,0 +1,243 @@
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <new>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/strings/str_format.h"
+#include "nyla/apps/wm/event_record.h"
+#include "nyla/apps/wm/window_manager.h"
+#include "nyla/apps/wm/wm_commands.h"
+#include "nyla/commons/containers/map.h"
+#include "nyla/commons/logging/init.h"
+#include "nyla/commons/os/clock.h"
+#include "nyla/commons/os/reactor.h"
+#include "nyla/commons/os/timerfd.h"
+#include "nyla/platform/x11/platform_x11.h"
+#include "xcb/xcb.h"
+#include "xcb/xproto.h"
+
+static uint64_t replayAllocations;
+
+auto operator new(size_t size) -> void *
+{
+    ++replayAllocations;
+    if (void *ptr = malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+namespace nyla
+{
+
+using namespace platform_x11_internal;
+
+static FILE *replayCapture;
+
+// Replies are queued per (window, property) in capture order and handed out when the WM harvests its fetches.
+static Map<std::pair<xcb_window_t, xcb_atom_t>, std::deque<xcb_get_property_reply_t *>> replayReplies;
+
+static auto TakeRecordedReply(xcb_window_t window, xcb_atom_t property, xcb_get_property_reply_t **reply) -> bool
+{
+    auto it = replayReplies.find({window, property});
+    if (it == replayReplies.end() || it->second.empty())
+        return false;
+
+    *reply = it->second.front();
+    it->second.pop_front();
+    return true;
+}
+
+static auto CopyPayload(const std::vector<char> &payload) -> void *
+{
+    void *copy = malloc(payload.size());
+    memcpy(copy, payload.data(), payload.size());
+    return copy;
+}
+
+// WMHandoffRestore reads its state from an fd, as it does after a hot restart.
+static void RestoreHandoff(const std::vector<char> &state)
+{
+    const int fd = memfd_create("wm-replay-handoff", MFD_CLOEXEC);
+    if (fd < 0 || write(fd, state.data(), state.size()) != static_cast<ssize_t>(state.size()) ||
+        !WMHandoffRestore(fd))
+    {
+        LOG(ERROR) << "could not restore the captured handoff state";
+    }
+    if (fd >= 0)
+        close(fd);
+}
+
+// Generated ids and monitor queries are recorded as the WM makes them, replaying the records before them brings the WM
+// to the same call with the matching record up next.
+static auto TakeNextRecord(WMRecordKind kind) -> WMRecord
+{
+    WMRecord record;
+    if (!WMRecordRead(replayCapture, record) || record.header.kind != kind)
+        LOG(QFATAL) << "replay diverged from the capture, expected a record of kind " << static_cast<int>(kind);
+    return record;
+}
+
+// Nothing reaches a server, requests are dropped and everything the WM reads comes from the capture.
+static void UseCapturedServer()
+{
+    wmCommandSink = [](std::span<const WMCommand> commands) -> void {};
+    wmServerSource = {
+        .pollForEvent = [](bool queuedOnly) -> xcb_generic_event_t * { return nullptr; },
+        .generateId = [] -> xcb_window_t { return TakeNextRecord(WMRecordKind::KGeneratedId).header.window; },
+        .queryMonitors = [] -> std::vector<X11Monitor> {
+            return WMRecordReadMonitors(TakeNextRecord(WMRecordKind::KMonitors));
+        },
+        .selectEvents = [](xcb_window_t window, uint32_t eventMask) -> void {},
+        .requestProperty = [](xcb_window_t window, xcb_atom_t property, uint32_t longLength) -> uint32_t { return 0; },
+        .pollForProperty = [](uint32_t sequence, xcb_window_t window, xcb_atom_t property,
+                              xcb_get_property_reply_t **reply) -> bool {
+            return TakeRecordedReply(window, property, reply);
+        },
+        .discardProperty = [](uint32_t sequence) -> void {},
+    };
+}
+
+auto Main(int argc, char **argv) -> int
+{
+    LoggingInit();
+
+    if (argc != 2)
+    {
+        LOG(ERROR) << "usage: " << argv[0] << " CAPTURE";
+        return 1;
+    }
+
+    replayCapture = WMRecordReaderOpen(argv[1]);
+    if (!replayCapture)
+        LOG(QFATAL) << "could not open capture " << argv[1];
+
+    WMRecord record;
+    if (!WMRecordRead(replayCapture, record) || !WMRecordApplyConfig(record))
+        LOG(QFATAL) << "capture " << argv[1] << " does not start with a config record";
+
+    UseCapturedServer();
+    ReactorInitialize();
+    TimersInitialize();
+    InitializeWM();
+
+    // Key presses are replayed against an empty table, the captured keycodes need not match the replay keymap.
+    static KeybindTable keybinds;
+    KeybindTableInitialize(keybinds, 0);
+
+    struct
+    {
+        uint64_t events;
+        uint64_t batches;
+        uint64_t dispatchNanos;
+        uint64_t dispatchAllocations;
+        uint64_t processCalls;
+        uint64_t processNanos;
+        uint64_t processAllocations;
+    } stats{};
+
+    std::vector<xcb_generic_event_t *> batch;
+    while (WMRecordRead(replayCapture, record))
+    {
+        switch (record.header.kind)
+        {
+        case WMRecordKind::KEvent: {
+            batch.emplace_back(static_cast<xcb_generic_event_t *>(CopyPayload(record.payload)));
+            break;
+        }
+
+        case WMRecordKind::KEventBatchEnd: {
+            stats.events += batch.size();
+            ++stats.batches;
+
+            const uint64_t allocations = replayAllocations;
+            const uint64_t start = GetMonotonicTimeNanos();
+            DispatchWMEvents(batch, keybinds);
+            stats.dispatchNanos += GetMonotonicTimeNanos() - start;
+            stats.dispatchAllocations += replayAllocations - allocations;
+
+            break;
+        }
+
+        case WMRecordKind::KPropertyReply: {
+            auto *reply =
+                static_cast<xcb_get_property_reply_t *>(record.payload.empty() ? nullptr : CopyPayload(record.payload));
+            replayReplies[{record.header.window, record.header.property}].emplace_back(reply);
+            break;
+        }
+
+        case WMRecordKind::KStartup: {
+            const auto *windows = reinterpret_cast<const xcb_window_t *>(record.payload.data());
+            for (size_t i = 0; i < record.payload.size() / sizeof(xcb_window_t); ++i)
+                ManageClient(windows[i]);
+
+            WMCommandsFlush();
+            break;
+        }
+
+        case WMRecordKind::KHandoff: {
+            RestoreHandoff(record.payload);
+
+            WMCommandsFlush();
+            break;
+        }
+
+        case WMRecordKind::KConfig:
+        case WMRecordKind::KGeneratedId:
+        case WMRecordKind::KMonitors: {
+            LOG(ERROR) << "ignoring a record of kind " << static_cast<int>(record.header.kind) << " out of place";
+            break;
+        }
+
+        case WMRecordKind::KProcessWM: {
+            ++stats.processCalls;
+
+            const uint64_t allocations = replayAllocations;
+            const uint64_t start = GetMonotonicTimeNanos();
+            ProcessWM();
+            stats.processNanos += GetMonotonicTimeNanos() - start;
+            stats.processAllocations += replayAllocations - allocations;
+
+            WMCommandsFlush();
+            break;
+        }
+        }
+    }
+    fclose(replayCapture);
+
+    auto perCall = [](uint64_t total, uint64_t calls) -> double { return calls ? double(total) / calls : 0; };
+
+    absl::PrintF("events: %v in %v batches\n", stats.events, stats.batches);
+    absl::PrintF("dispatch: %.0f ns/event, %.2f allocations/event\n", perCall(stats.dispatchNanos, stats.events),
+                 perCall(stats.dispatchAllocations, stats.events));
+    absl::PrintF("process_wm: %v calls, %.0f ns/call, %.2f allocations/call\n", stats.processCalls,
+                 perCall(stats.processNanos, stats.processCalls), perCall(stats.processAllocations, stats.processCalls));
+    absl::PrintF("\n%s", WMLatencyReport());
+
+    return 0;
+}
+
+} // namespace nyla
+
+auto main(int argc, char **argv) -> int
+{
+    return nyla::Main(argc, argv);
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "nyla/commons/os/reactor.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <iterator>
+
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+
+namespace nyla
+{
+
+Reactor reactor;
+
+static auto EpollEvents(uint32_t events, ReactorTrigger trigger) -> uint32_t
+{
+    return trigger == ReactorTrigger::KEdge ? events | EPOLLET : events;
+}
+
+void ReactorInitialize()
+{
+    reactor.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor.epfd == -1)
+        LOG(QFATAL) << "epoll_create1 failed";
+}
+
+void ReactorAdd(int fd, uint32_t events, ReactorTrigger trigger, ReactorHandler handler, void *data)
+{
+    CHECK(handler);
+
+    auto [it, inserted] = reactor.sources.try_emplace(fd, ReactorSource{
+                                                              .handler = handler,
+                                                              .data = data,
+                                                              .events = events,
+                                                              .trigger = trigger,
+                                                          });
+    CHECK(inserted);
+
+    epoll_event ev{.events = EpollEvents(events, trigger), .data = {.fd = fd}};
+    CHECK_EQ(epoll_ctl(reactor.epfd, EPOLL_CTL_ADD, fd, &ev), 0);
+}
+
+void ReactorModify(int fd, uint32_t events)
+{
+    auto it = reactor.sources.find(fd);
+    CHECK(it != reactor.sources.end());
+
+    ReactorSource &source = it->second;
+    if (source.events == events)
+        return;
+    source.events = events;
+
+    epoll_event ev{.events = EpollEvents(events, source.trigger), .data = {.fd = fd}};
+    CHECK_EQ(epoll_ctl(reactor.epfd, EPOLL_CTL_MOD, fd, &ev), 0);
+}
+
+void ReactorRemove(int fd)
+{
+    if (!reactor.sources.erase(fd))
+        return;
+    epoll_ctl(reactor.epfd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void ReactorWait(int timeoutMillis)
+{
+    epoll_event events[16];
+    int n = epoll_wait(reactor.epfd, events, std::size(events), timeoutMillis);
+    if (n == -1)
+    {
+        if (errno != EINTR)
+            LOG(ERROR) << "epoll_wait failed";
+        return;
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        // Looked up again for every event, an earlier handler may have removed this source.
+        auto it = reactor.sources.find(events[i].data.fd);
+        if (it == reactor.sources.end())
+            continue;
+
+        const ReactorSource &source = it->second;
+        source.handler(events[i].data.fd, events[i].events, source.data);
+    }
+}
+
+} // namespace nyla
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+#include "nyla/commons/containers/map.h"
+
+namespace nyla
+{
+
+enum class ReactorTrigger
+{
+    KLevel,
+    KEdge,
+};
+
+// Edge-triggered handlers must drain their fd until EAGAIN, otherwise they are not called again.
+using ReactorHandler = void (*)(int fd, uint32_t events, void *data);
+
+struct ReactorSource
+{
+    ReactorHandler handler;
+    void *data;
+    uint32_t events;
+    ReactorTrigger trigger;
+};
+
+struct Reactor
+{
+    int epfd;
+    Map<int, ReactorSource> sources;
+};
+extern Reactor reactor;
+
+void ReactorInitialize();
+void ReactorAdd(int fd, uint32_t events, ReactorTrigger trigger, ReactorHandler handler, void *data);
+void ReactorModify(int fd, uint32_t events);
+void ReactorRemove(int fd);
+void ReactorWait(int timeoutMillis);
+
+} // namespace nyla
\ No newline at end of file
@@ -1,77 +1,118 @@
 #include "nyla/commons/os/spawn.h"
 
 #include <fcntl.h>
-#include <linux/close_range.h>
-#include <sys/signal.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <csignal>
+#include <cstring>
+#include <fstream>
 #include <span>
+#include <string>
 
+#include "absl/cleanup/cleanup.h"
 #include "absl/log/log.h"
+#include "nyla/commons/os/reactor.h"
 
 namespace nyla
 {
 
-auto Spawn(std::span<const char *const> cmd) -> bool
+static void WatchChild(pid_t pid)
 {
-    { // TODO: move this somewhere
-        static bool installed = false;
-        if (!installed)
-        {
-            struct sigaction sa;
-            sa.sa_handler = [](int signum) -> void {
-                pid_t pid;
-                int status;
-                while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
-                    ;
-            };
-            sigemptyset(&sa.sa_mask);
-            sa.sa_flags = SA_RESTART;
-            if (sigaction(SIGCHLD, &sa, NULL) == -1)
-            {
-                LOG(ERROR) << "sigaction failed";
-                return false;
-            }
-            else
+    const int pidfd = pidfd_open(pid, 0);
+    if (pidfd == -1)
+    {
+        PLOG(ERROR) << "pidfd_open " << pid;
+        return;
+    }
+
+    ReactorAdd(
+        pidfd, EPOLLIN, ReactorTrigger::KLevel,
+        [](int fd, uint32_t events, void *data) -> void {
+            siginfo_t info{};
+            if (waitid(P_PIDFD, fd, &info, WEXITED | WNOHANG) == 0 && info.si_pid &&
+                (info.si_code != CLD_EXITED || info.si_status))
             {
-                installed = true;
+                LOG(INFO) << "child " << info.si_pid << " exited with code " << info.si_code << " status "
+                          << info.si_status;
             }
-        }
+
+            ReactorRemove(fd);
+            close(fd);
+        },
+        nullptr);
+}
+
+static void MoveToCgroup(pid_t pid, const char *cgroup)
+{
+    const std::string procs = std::string{cgroup} + "/cgroup.procs";
+
+    const int fd = open(procs.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        PLOG(ERROR) << "could not open " << procs;
+        return;
     }
+    absl::Cleanup fdCloser = [fd] -> void { close(fd); };
+
+    const std::string pidString = std::to_string(pid);
+    if (write(fd, pidString.data(), pidString.size()) == -1)
+        PLOG(ERROR) << "could not move " << pid << " to " << cgroup;
+}
 
+auto Spawn(std::span<const char *const> cmd, const SpawnOptions &options) -> bool
+{
     if (cmd.size() <= 1)
         return false;
     if (cmd.back() != nullptr)
         return false;
 
-    switch (fork())
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    absl::Cleanup actionsDestroyer = [&actions] -> void { posix_spawn_file_actions_destroy(&actions); };
+
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDWR, 0);
+    posix_spawn_file_actions_adddup2(&actions, STDIN_FILENO, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, STDIN_FILENO, STDERR_FILENO);
+    posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    absl::Cleanup attrDestroyer = [&attr] -> void { posix_spawnattr_destroy(&attr); };
+
+    // Children start with default signal handling whatever the caller has set up.
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attr, &signals);
+    sigfillset(&signals);
+    posix_spawnattr_setsigdefault(&attr, &signals);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    // glibc runs the child on a CLONE_VM | CLONE_VFORK clone and reports a failed exec here.
+    pid_t pid;
+    if (const int error = posix_spawnp(&pid, cmd[0], &actions, &attr, const_cast<char *const *>(cmd.data()), environ))
     {
-    case -1:
+        LOG(ERROR) << "could not spawn " << cmd[0] << ": " << strerror(error);
         return false;
-    case 0:
-        break;
-    default:
-        return true;
     }
 
-    int devNullFd = open("/dev/null", O_RDWR);
-    if (devNullFd != -1)
-    {
-        dup2(devNullFd, STDIN_FILENO);
-        dup2(devNullFd, STDOUT_FILENO);
-        dup2(devNullFd, STDERR_FILENO);
-    }
+    if (options.cgroup)
+        MoveToCgroup(pid, options.cgroup);
 
-    if (close_range(3, ~0U, CLOSE_RANGE_UNSHARE) != 0)
-    {
-        goto failure;
-    }
+    WatchChild(pid);
+    return true;
+}
 
-    execvp(cmd[0], const_cast<char *const *>(cmd.data()));
+void SpawnAdoptChildren()
+{
+    std::ifstream children{"/proc/self/task/" + std::to_string(getpid()) + "/children"};
 
-failure:
-    _exit(127);
+    pid_t pid;
+    while (children >> pid)
+        WatchChild(pid);
 }
 
 } // namespace nyla
\ No newline at end of file
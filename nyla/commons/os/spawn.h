@@ -5,6 +5,18 @@
 namespace nyla
 {
 
-auto Spawn(std::span<const char *const> cmd) -> bool;
+struct SpawnOptions
+{
+    // A cgroup v2 directory the child is moved into right after it has been executed, optional.
+    const char *cgroup;
+};
+
+// Runs cmd, a null-terminated argv, with stdio on /dev/null. The caller's address space is shared until the exec
+// instead of being copied, so the cost does not grow with its size. Exits are reaped through pidfds on the reactor,
+// which must be initialized.
+auto Spawn(std::span<const char *const> cmd, const SpawnOptions &options = {}) -> bool;
+
+// Reaps children that were spawned before an exec of the calling process.
+void SpawnAdoptChildren();
 
-}
+} // namespace nyla
\ No newline at end of file
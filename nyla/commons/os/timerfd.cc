@@ -1,9 +1,23 @@
 #include "nyla/commons/os/timerfd.h"
 
+#include <sys/epoll.h>
 #include <sys/timerfd.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "nyla/commons/containers/map.h"
+#include "nyla/commons/os/reactor.h"
 
 namespace nyla
 {
@@ -28,4 +42,240 @@ auto MakeTimerFd(std::chrono::duration<double> interval) -> int
     return fd;
 }
 
+// Hierarchical timer wheel with millisecond ticks. A timer sits on the lowest level whose window it shares with the
+// current time, i.e. level l holds timers that only differ from now in digit l (6 bits per digit) or below. Whenever
+// now enters a new slot of a higher level, that slot is cascaded down.
+
+static constexpr uint32_t kWheelBits = 6;
+static constexpr uint32_t kWheelSlots = 1 << kWheelBits;
+static constexpr uint32_t kWheelLevels = 4;
+static constexpr uint32_t kWheelRangeBits = kWheelBits * kWheelLevels;
+static constexpr uint64_t kNoDeadline = std::numeric_limits<uint64_t>::max();
+
+struct Timer
+{
+    uint64_t expiry;
+    uint64_t period;
+    uint64_t slack;
+    TimerHandler handler;
+    void *data;
+};
+
+struct TimerEntry
+{
+    uint64_t timer;
+    uint64_t expiry;
+};
+
+static struct
+{
+    int fd;
+    uint64_t now;
+    uint64_t armedFor;
+    uint64_t nextTimer;
+
+    Map<uint64_t, Timer> timers;
+
+    std::array<std::array<std::vector<TimerEntry>, kWheelSlots>, kWheelLevels> slots;
+    std::array<uint64_t, kWheelLevels> occupied;
+    std::vector<TimerEntry> overflow;
+} wheel;
+
+static auto NowMillis() -> uint64_t
+{
+    timespec ts{};
+    CHECK_EQ(clock_gettime(CLOCK_MONOTONIC, &ts), 0);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static auto Digit(uint64_t time, uint32_t level) -> uint32_t
+{
+    return (time >> (kWheelBits * level)) & (kWheelSlots - 1);
+}
+
+// Rounds up to the coarsest power of two within the slack, so that timers with similar deadlines line up.
+static auto ApplySlack(uint64_t expiry, uint64_t slack) -> uint64_t
+{
+    if (slack < 2)
+        return expiry;
+
+    const uint64_t align = std::bit_floor(slack);
+    return (expiry + align - 1) & ~(align - 1);
+}
+
+static void Place(TimerEntry entry)
+{
+    const uint64_t expiry = std::max(entry.expiry, wheel.now);
+
+    for (uint32_t level = 0; level < kWheelLevels; ++level)
+    {
+        const uint32_t shift = kWheelBits * (level + 1);
+        if ((expiry >> shift) != (wheel.now >> shift))
+            continue;
+
+        const uint32_t digit = Digit(expiry, level);
+        wheel.slots[level][digit].emplace_back(entry);
+        wheel.occupied[level] |= uint64_t{1} << digit;
+        return;
+    }
+
+    wheel.overflow.emplace_back(entry);
+}
+
+static auto NextDeadline() -> uint64_t
+{
+    for (uint32_t level = 0; level < kWheelLevels; ++level)
+    {
+        // Slots behind the current digit have been expired or cascaded, on higher levels so has the current one.
+        const uint32_t first = Digit(wheel.now, level) + (level ? 1 : 0);
+        if (first >= kWheelSlots)
+            continue;
+
+        const uint64_t pending = wheel.occupied[level] & (~uint64_t{0} << first);
+        if (!pending)
+            continue;
+
+        const uint32_t shift = kWheelBits * (level + 1);
+        return (wheel.now >> shift << shift) | (uint64_t{std::countr_zero(pending)} << (kWheelBits * level));
+    }
+
+    if (!wheel.overflow.empty())
+        return ((wheel.now >> kWheelRangeBits) + 1) << kWheelRangeBits;
+
+    return kNoDeadline;
+}
+
+static void Cascade()
+{
+    if (!(wheel.now & ((uint64_t{1} << kWheelRangeBits) - 1)))
+    {
+        for (TimerEntry entry : std::exchange(wheel.overflow, {}))
+            Place(entry);
+    }
+
+    for (uint32_t level = kWheelLevels - 1; level > 0; --level)
+    {
+        if (wheel.now & ((uint64_t{1} << (kWheelBits * level)) - 1))
+            continue;
+
+        const uint32_t digit = Digit(wheel.now, level);
+        wheel.occupied[level] &= ~(uint64_t{1} << digit);
+        for (TimerEntry entry : std::exchange(wheel.slots[level][digit], {}))
+            Place(entry);
+    }
+}
+
+static void Expire()
+{
+    const uint32_t digit = Digit(wheel.now, 0);
+    wheel.occupied[0] &= ~(uint64_t{1} << digit);
+
+    for (TimerEntry entry : std::exchange(wheel.slots[0][digit], {}))
+    {
+        // Cancelled and rescheduled timers leave stale entries behind.
+        auto it = wheel.timers.find(entry.timer);
+        if (it == wheel.timers.end() || it->second.expiry != entry.expiry)
+            continue;
+
+        Timer &timer = it->second;
+        const TimerHandler handler = timer.handler;
+        void *data = timer.data;
+
+        if (timer.period)
+        {
+            timer.expiry = ApplySlack(timer.expiry + timer.period, timer.slack);
+            Place(TimerEntry{.timer = entry.timer, .expiry = timer.expiry});
+        }
+        else
+        {
+            wheel.timers.erase(it);
+        }
+
+        handler(data);
+    }
+}
+
+static void Arm()
+{
+    const uint64_t deadline = NextDeadline();
+    if (deadline == wheel.armedFor)
+        return;
+    wheel.armedFor = deadline;
+
+    itimerspec timerSpec{};
+    if (deadline != kNoDeadline)
+    {
+        timerSpec.it_value = {
+            .tv_sec = static_cast<time_t>(deadline / 1000),
+            .tv_nsec = static_cast<long>(deadline % 1000 * 1000000),
+        };
+    }
+    timerfd_settime(wheel.fd, TFD_TIMER_ABSTIME, &timerSpec, nullptr);
+}
+
+static void RunTimers()
+{
+    // Every time now moves it cascades right away, Place and NextDeadline rely on that.
+    const uint64_t now = NowMillis();
+    while (wheel.now <= now)
+    {
+        Expire();
+
+        wheel.now = std::min(NextDeadline(), now + 1);
+        Cascade();
+    }
+
+    // The timerfd stays disarmed after firing, arming for the same deadline again must not be skipped.
+    wheel.armedFor = kNoDeadline;
+    Arm();
+}
+
+void TimersInitialize()
+{
+    wheel.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (wheel.fd == -1)
+        LOG(QFATAL) << "timerfd_create failed";
+
+    wheel.now = NowMillis();
+    wheel.armedFor = kNoDeadline;
+    wheel.nextTimer = 1;
+
+    ReactorAdd(
+        wheel.fd, EPOLLIN, ReactorTrigger::KEdge,
+        [](int fd, uint32_t events, void *data) -> void {
+            uint64_t expirations;
+            if (read(fd, &expirations, sizeof(expirations)) <= 0)
+                return;
+            RunTimers();
+        },
+        nullptr);
+}
+
+auto TimerAdd(uint64_t delayMillis, uint64_t periodMillis, uint64_t slackMillis, TimerHandler handler, void *data)
+    -> uint64_t
+{
+    CHECK(handler);
+
+    // Until the wheel catches up on the next expiry, now may lag behind the clock.
+    const uint64_t expiry = ApplySlack(NowMillis() + delayMillis, slackMillis);
+
+    const uint64_t timer = wheel.nextTimer++;
+    wheel.timers.try_emplace(timer, Timer{
+                                        .expiry = expiry,
+                                        .period = periodMillis,
+                                        .slack = slackMillis,
+                                        .handler = handler,
+                                        .data = data,
+                                    });
+
+    Place(TimerEntry{.timer = timer, .expiry = expiry});
+    Arm();
+    return timer;
+}
+
+void TimerCancel(uint64_t timer)
+{
+    wheel.timers.erase(timer);
+}
+
 } // namespace nyla
\ No newline at end of file
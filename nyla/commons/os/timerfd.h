@@ -1,10 +1,23 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 
 namespace nyla
 {
 
 auto MakeTimerFd(std::chrono::duration<double> interval) -> int;
 
-}
+using TimerHandler = void (*)(void *data);
+
+// Timers share a single timerfd registered with the reactor, which must be initialized first. The timerfd is only
+// armed for the earliest pending deadline, so nothing wakes up while no timer is pending.
+void TimersInitialize();
+
+// A period of 0 makes a one-shot timer. The deadline may be pushed back by up to slackMillis to expire together with
+// other timers.
+auto TimerAdd(uint64_t delayMillis, uint64_t periodMillis, uint64_t slackMillis, TimerHandler handler, void *data)
+    -> uint64_t;
+void TimerCancel(uint64_t timer);
+
+} // namespace nyla
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "nyla/commons/stats/latency_histogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/str_format.h"
+
+namespace nyla
+{
+
+static auto BucketIndex(uint64_t value) -> uint32_t
+{
+    if (value < kLatencyHistogramSubBuckets)
+        return value;
+
+    const uint32_t shift = std::bit_width(value) - kLatencyHistogramSubBucketBits;
+    const uint32_t idx = kLatencyHistogramSubBuckets + (shift - 1) * kLatencyHistogramHalfBuckets +
+                         ((value >> shift) - kLatencyHistogramHalfBuckets);
+    return std::min(idx, kLatencyHistogramBuckets - 1);
+}
+
+static auto BucketUpperBound(uint32_t idx) -> uint64_t
+{
+    if (idx < kLatencyHistogramSubBuckets)
+        return idx;
+
+    const uint32_t shift = (idx - kLatencyHistogramSubBuckets) / kLatencyHistogramHalfBuckets + 1;
+    const uint64_t sub =
+        (idx - kLatencyHistogramSubBuckets) % kLatencyHistogramHalfBuckets + kLatencyHistogramHalfBuckets;
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogramRecord(LatencyHistogram &histogram, uint64_t value)
+{
+    ++histogram.counts[BucketIndex(value)];
+    ++histogram.total;
+    histogram.max = std::max(histogram.max, value);
+}
+
+void LatencyHistogramReset(LatencyHistogram &histogram)
+{
+    histogram = {};
+}
+
+auto LatencyHistogramQuantile(const LatencyHistogram &histogram, double quantile) -> uint64_t
+{
+    if (!histogram.total)
+        return 0;
+
+    const auto rank = std::max<uint64_t>(1, std::ceil(quantile * histogram.total));
+    uint64_t seen = 0;
+    for (uint32_t idx = 0; idx < kLatencyHistogramBuckets; ++idx)
+    {
+        seen += histogram.counts[idx];
+        if (seen >= rank)
+            return std::min(BucketUpperBound(idx), histogram.max);
+    }
+    return histogram.max;
+}
+
+auto LatencyHistogramFormat(const LatencyHistogram &histogram) -> std::string
+{
+    return absl::StrFormat("count=%v p50=%v p99=%v p999=%v max=%v", histogram.total,
+                           LatencyHistogramQuantile(histogram, 0.5), LatencyHistogramQuantile(histogram, 0.99),
+                           LatencyHistogramQuantile(histogram, 0.999), histogram.max);
+}
+
+} // namespace nyla
\ No newline at end of file
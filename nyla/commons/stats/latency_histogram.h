@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace nyla
+{
+
+// Log-linear buckets in the style of HdrHistogram. Every power of two range is split into kLatencyHistogramHalfBuckets
+// linear buckets, which keeps the relative error of the reported percentiles below 1/kLatencyHistogramHalfBuckets.
+
+inline constexpr uint32_t kLatencyHistogramSubBucketBits = 7;
+inline constexpr uint32_t kLatencyHistogramSubBuckets = 1 << kLatencyHistogramSubBucketBits;
+inline constexpr uint32_t kLatencyHistogramHalfBuckets = kLatencyHistogramSubBuckets / 2;
+
+// Values above ~71 minutes of microseconds land in the last bucket, max still records them exactly.
+inline constexpr uint32_t kLatencyHistogramMaxBits = 32;
+inline constexpr uint32_t kLatencyHistogramBuckets =
+    kLatencyHistogramSubBuckets +
+    (kLatencyHistogramMaxBits - kLatencyHistogramSubBucketBits) * kLatencyHistogramHalfBuckets;
+
+struct LatencyHistogram
+{
+    std::array<uint64_t, kLatencyHistogramBuckets> counts;
+    uint64_t total;
+    uint64_t max;
+};
+
+void LatencyHistogramRecord(LatencyHistogram &histogram, uint64_t value);
+void LatencyHistogramReset(LatencyHistogram &histogram);
+
+// Upper bound of the bucket holding the given quantile, clamped to the recorded max.
+auto LatencyHistogramQuantile(const LatencyHistogram &histogram, double quantile) -> uint64_t;
+
+// Single line with count, p50, p99, p999 and max.
+auto LatencyHistogramFormat(const LatencyHistogram &histogram) -> std::string;
+
+} // namespace nyla
\ No newline at end of file
@@ -1,16 +1,149 @@
 #include "nyla/dbus/dbus.h"
 
+#include <sys/epoll.h>
+
+#include <algorithm>
+#include <cstdint>
+
 #include "absl/cleanup/cleanup.h"
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "dbus/dbus.h"
 #include "nyla/commons/containers/set.h"
+#include "nyla/commons/os/reactor.h"
+#include "nyla/commons/os/timerfd.h"
 
 namespace nyla
 {
 
 DBus dbus;
 
+static void UpdateWatchedFd(int fd)
+{
+    uint32_t events = 0;
+    for (DBusWatch *watch : dbus.watches.at(fd))
+    {
+        if (!dbus_watch_get_enabled(watch))
+            continue;
+
+        const uint32_t flags = dbus_watch_get_flags(watch);
+        if (flags & DBUS_WATCH_READABLE)
+            events |= EPOLLIN;
+        if (flags & DBUS_WATCH_WRITABLE)
+            events |= EPOLLOUT;
+    }
+    ReactorModify(fd, events);
+}
+
+static void HandleWatchedFd(int fd, uint32_t events, void *data)
+{
+    uint32_t ready = 0;
+    if (events & EPOLLIN)
+        ready |= DBUS_WATCH_READABLE;
+    if (events & EPOLLOUT)
+        ready |= DBUS_WATCH_WRITABLE;
+    if (events & EPOLLERR)
+        ready |= DBUS_WATCH_ERROR;
+    if (events & EPOLLHUP)
+        ready |= DBUS_WATCH_HANGUP;
+
+    // Handling one watch can add or remove others on the same fd.
+    std::vector<DBusWatch *> watches = dbus.watches.at(fd);
+    for (DBusWatch *watch : watches)
+    {
+        auto it = dbus.watches.find(fd);
+        if (it == dbus.watches.end())
+            break;
+        if (std::ranges::find(it->second, watch) == it->second.end())
+            continue;
+        if (!dbus_watch_get_enabled(watch))
+            continue;
+
+        const uint32_t flags = ready & (dbus_watch_get_flags(watch) | DBUS_WATCH_ERROR | DBUS_WATCH_HANGUP);
+        if (flags)
+            dbus_watch_handle(watch, flags);
+    }
+
+    DBusProcess();
+}
+
+static auto AddWatch(DBusWatch *watch, void *data) -> dbus_bool_t
+{
+    const int fd = dbus_watch_get_unix_fd(watch);
+
+    auto [it, inserted] = dbus.watches.try_emplace(fd);
+    if (inserted)
+        ReactorAdd(fd, 0, ReactorTrigger::KLevel, HandleWatchedFd, nullptr);
+    it->second.emplace_back(watch);
+
+    UpdateWatchedFd(fd);
+    return true;
+}
+
+static void RemoveWatch(DBusWatch *watch, void *data)
+{
+    const int fd = dbus_watch_get_unix_fd(watch);
+
+    auto it = dbus.watches.find(fd);
+    if (it == dbus.watches.end())
+        return;
+
+    std::erase(it->second, watch);
+    if (it->second.empty())
+    {
+        dbus.watches.erase(it);
+        ReactorRemove(fd);
+        return;
+    }
+
+    UpdateWatchedFd(fd);
+}
+
+static void ToggleWatch(DBusWatch *watch, void *data)
+{
+    UpdateWatchedFd(dbus_watch_get_unix_fd(watch));
+}
+
+static void ArmTimeout(DBusTimeout *timeout)
+{
+    if (uint64_t timer = reinterpret_cast<uintptr_t>(dbus_timeout_get_data(timeout)))
+        TimerCancel(timer);
+
+    uint64_t timer = 0;
+    if (dbus_timeout_get_enabled(timeout))
+    {
+        // Reply timeouts are coarse, let them share wakeups with other timers.
+        const uint64_t interval = dbus_timeout_get_interval(timeout);
+        timer = TimerAdd(
+            interval, interval, interval / 8,
+            [](void *data) -> void {
+                dbus_timeout_handle(static_cast<DBusTimeout *>(data));
+                DBusProcess();
+            },
+            timeout);
+    }
+    dbus_timeout_set_data(timeout, reinterpret_cast<void *>(static_cast<uintptr_t>(timer)), nullptr);
+}
+
+static auto AddTimeout(DBusTimeout *timeout, void *data) -> dbus_bool_t
+{
+    dbus_timeout_set_data(timeout, nullptr, nullptr);
+    ArmTimeout(timeout);
+    return true;
+}
+
+static void RemoveTimeout(DBusTimeout *timeout, void *data)
+{
+    if (uint64_t timer = reinterpret_cast<uintptr_t>(dbus_timeout_get_data(timeout)))
+        TimerCancel(timer);
+    dbus_timeout_set_data(timeout, nullptr, nullptr);
+}
+
+static void ToggleTimeout(DBusTimeout *timeout, void *data)
+{
+    ArmTimeout(timeout);
+}
+
 void DBusInitialize()
 {
     DBusErrorWrapper err;
@@ -23,7 +156,24 @@ void DBusInitialize()
     }
 
     dbus_connection_set_exit_on_disconnect(dbus.conn, false);
+
+    // Messages can be queued while the socket is drained by a blocking call, those never make the fd readable.
+    dbus_connection_set_dispatch_status_function(
+        dbus.conn,
+        [](DBusConnection *conn, DBusDispatchStatus status, void *data) -> void {
+            if (status == DBUS_DISPATCH_DATA_REMAINS)
+                dbus.dispatchPending = true;
+        },
+        nullptr, nullptr);
+
+    if (!dbus_connection_set_watch_functions(dbus.conn, AddWatch, RemoveWatch, ToggleWatch, nullptr, nullptr) ||
+        !dbus_connection_set_timeout_functions(dbus.conn, AddTimeout, RemoveTimeout, ToggleTimeout, nullptr, nullptr))
+    {
+        LOG(ERROR) << "could not integrate dbus with the reactor";
+    }
+
     dbus_connection_flush(dbus.conn);
+    dbus.dispatchPending = true;
 }
 
 void DBusTrackNameOwnerChanges()
@@ -47,7 +197,7 @@ void DBusProcess()
     if (!dbus.conn)
         return;
 
-    dbus_connection_read_write(dbus.conn, 0);
+    dbus.dispatchPending = false;
 
     for (;;)
     {
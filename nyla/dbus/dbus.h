@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "dbus/dbus.h"
 #include "nyla/commons/containers/map.h"
 
@@ -17,9 +19,12 @@ struct DBus
 {
     DBusConnection *conn;
     Map<std::string_view, DBusObjectPathHandler *> handlers;
+    Map<int, std::vector<DBusWatch *>> watches;
+    bool dispatchPending;
 };
 extern DBus dbus;
 
+// Registers the bus socket with the reactor and timeouts with the timer wheel, both must be initialized first.
 void DBusInitialize();
 void DBusTrackNameOwnerChanges();
 void DBusRegisterHandler(const char *bus, const char *path, DBusObjectPathHandler *handler);
@@ -53,14 +53,14 @@ static auto GetContent(DebugFsFile &file) -> std::string_view
 
 static auto MakeFileEntryParam(ino_t inode, DebugFsFile &file) -> fuse_entry_param
 {
-    constexpr uint32_t kMode = S_IFREG | 0444;
+    const uint32_t mode = S_IFREG | (file.writeHandler ? 0644 : 0444);
 
     return {
         .ino = inode,
         .attr =
             {
                 .st_nlink = 1,
-                .st_mode = kMode,
+                .st_mode = mode,
                 .st_size = static_cast<off_t>(GetContent(file).size()),
             },
         .attr_timeout = 1.0,
@@ -131,6 +131,29 @@ static void HandleGetAttr(fuse_req_t req, fuse_ino_t inode, fuse_file_info *file
     }
 }
 
+static void HandleSetAttr(fuse_req_t req, fuse_ino_t inode, struct stat *attr, int toSet, fuse_file_info *fileInfo)
+{
+    // LOG(INFO) << "set attr " << inode;
+
+    auto it = debugfs.files.find(inode);
+    if (it == debugfs.files.end())
+    {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    auto &[_, file] = *it;
+    if (!file.writeHandler)
+    {
+        fuse_reply_err(req, EACCES);
+        return;
+    }
+
+    // Only reached through O_TRUNC on open, the content is always regenerated so there is nothing to truncate.
+    fuse_entry_param entryParam = MakeFileEntryParam(inode, file);
+    fuse_reply_attr(req, &entryParam.attr, 1.0);
+}
+
 static void HandleGetXAttr(fuse_req_t req, fuse_ino_t inode, const char *name, size_t size)
 {
     // LOG(INFO) << "get x attr";
@@ -163,19 +186,22 @@ static void HandleOpen(fuse_req_t req, fuse_ino_t inode, fuse_file_info *fileInf
         return;
     }
 
-    if ((fileInfo->flags & O_ACCMODE) != O_RDONLY)
+    auto it = debugfs.files.find(inode);
+    if (it == debugfs.files.end())
     {
-        fuse_reply_err(req, EACCES);
+        fuse_reply_err(req, ENOENT);
         return;
     }
 
-    auto it = debugfs.files.find(inode);
-    if (it == debugfs.files.end())
+    auto &[_, file] = *it;
+    if ((fileInfo->flags & O_ACCMODE) != O_RDONLY && !file.writeHandler)
     {
-        fuse_reply_err(req, ENOENT);
+        fuse_reply_err(req, EACCES);
         return;
     }
 
+    // Content is regenerated on read, the page cache and the cached size would hand out a stale or cut off copy.
+    fileInfo->direct_io = 1;
     fuse_reply_open(req, fileInfo);
 }
 
@@ -199,6 +225,31 @@ static void HandleRead(fuse_req_t req, fuse_ino_t inode, size_t size, off_t offs
     }
 }
 
+static void HandleWrite(fuse_req_t req, fuse_ino_t inode, const char *buf, size_t size, off_t offset,
+                        fuse_file_info *fileInfo)
+{
+    // LOG(INFO) << "write " << inode << " " << size << " " << offset;
+
+    auto it = debugfs.files.find(inode);
+    if (it == debugfs.files.end())
+    {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    auto &[_, file] = *it;
+    if (!file.writeHandler)
+    {
+        fuse_reply_err(req, EACCES);
+        return;
+    }
+
+    file.writeHandler(file, std::string_view{buf, size});
+    file.contentTime = 0;
+
+    fuse_reply_write(req, size);
+}
+
 static void HandleReadDir(fuse_req_t req, fuse_ino_t inode, size_t size, off_t offset, fuse_file_info *fileInfo)
 {
     // LOG(INFO) << "read dir " << inode << " " << size << " " << offset;
@@ -247,8 +298,10 @@ void DebugFsInitialize(const std::string &path)
         .init = HandleInit,
         .lookup = HandleLookup,
         .getattr = HandleGetAttr,
+        .setattr = HandleSetAttr,
         .open = HandleOpen,
         .read = HandleRead,
+        .write = HandleWrite,
         .readdir = HandleReadDir,
         .setxattr = HandleSetXAttr,
         .getxattr = HandleGetXAttr,
@@ -274,8 +327,19 @@ void DebugFsInitialize(const std::string &path)
     LOG(INFO) << "initialized debugfs";
 }
 
+void DebugFsShutdown()
+{
+    if (!debugfs.session)
+        return;
+
+    fuse_session_unmount(debugfs.session);
+    fuse_session_destroy(debugfs.session);
+    debugfs.session = nullptr;
+    debugfs.fd = -1;
+}
+
 void DebugFsRegister(const char *name, void *data, void (*setContentHandler)(DebugFsFile &),
-                     void (*readNotifyHandler)(DebugFsFile &))
+                     void (*readNotifyHandler)(DebugFsFile &), void (*writeHandler)(DebugFsFile &, std::string_view))
 {
     LOG(INFO) << "registering debugfs file " << name;
 
@@ -285,6 +349,7 @@ void DebugFsRegister(const char *name, void *data, void (*setContentHandler)(Deb
                                            .data = data,
                                            .setContentHandler = setContentHandler,
                                            .readNotifyHandler = readNotifyHandler,
+                                           .writeHandler = writeHandler,
                                        });
 }
 
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 #define FUSE_USE_VERSION 316
 
@@ -19,6 +20,7 @@ struct DebugFsFile
     uint64_t contentTime;
     void (*setContentHandler)(DebugFsFile &);
     void (*readNotifyHandler)(DebugFsFile &);
+    void (*writeHandler)(DebugFsFile &, std::string_view);
 };
 
 struct DebugFs
@@ -31,6 +33,11 @@ extern DebugFs debugfs;
 
 void DebugFsInitialize(const std::string &path);
 void DebugFsProcess();
+// Unmounts the filesystem, registered files are kept for a later DebugFsInitialize.
+void DebugFsShutdown();
+
+// Files without a write handler are read-only.
 void DebugFsRegister(const char *name, void *data, void (*setContentHandler)(DebugFsFile &),
-                     void (*readNotifyHandler)(DebugFsFile &));
+                     void (*readNotifyHandler)(DebugFsFile &),
+                     void (*writeHandler)(DebugFsFile &, std::string_view) = nullptr);
 } // namespace nyla
\ No newline at end of file
@@ -48,6 +48,7 @@ struct PlatformProcessEventsCallbacks
     void (*handleKeyRelease)(void *user, uint32_t code);
     void (*handleMousePress)(void *user, uint32_t code);
     void (*handleMouseRelease)(void *user, uint32_t code);
+    void (*handlePropertyNotify)(void *user, uint32_t window, uint32_t atom, bool deleted);
 };
 
 struct PlatformProcessEventsResult
@@ -16,8 +16,10 @@
 #include "nyla/commons/os/clock.h"
 #include "nyla/platform/key_physical.h"
 #include "nyla/platform/platform.h"
+#include "nyla/platform/x11/platform_x11_audit.h"
 #include "xcb/xcb.h"
 #include "xcb/xcb_aux.h"
+#include "xcb/randr.h"
 #include "xcb/xinput.h"
 #include "xcb/xproto.h"
 #include "xkbcommon/xkbcommon-x11.h"
@@ -82,13 +84,13 @@ auto PlatformCreateWindow() -> PlatformWindow
 {
     xcb_window_t window = xcb_generate_id(x11.conn);
 
-    CHECK(!xcb_request_check(
+    CHECK(!X11_BLOCKING(xcb_request_check(
         x11.conn, xcb_create_window_checked(
                       x11.conn, XCB_COPY_FROM_PARENT, window, x11.screen->root, 0, 0, x11.screen->width_in_pixels,
                       x11.screen->height_in_pixels, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT, x11.screen->root_visual,
                       XCB_CW_OVERRIDE_REDIRECT | XCB_CW_EVENT_MASK,
                       (uint32_t[]){false, XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE |
-                                              XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE})));
+                                              XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE}))));
 
     xcb_map_window(x11.conn, window);
     xcb_flush(x11.conn);
@@ -99,7 +101,7 @@ auto PlatformCreateWindow() -> PlatformWindow
 auto PlatformGetWindowSize(PlatformWindow window) -> PlatformWindowSize
 {
     const xcb_get_geometry_reply_t *windowGeometry =
-        xcb_get_geometry_reply(x11.conn, xcb_get_geometry(x11.conn, window.handle), nullptr);
+        X11_BLOCKING(xcb_get_geometry_reply(x11.conn, xcb_get_geometry(x11.conn, window.handle), nullptr));
     return {.width = windowGeometry->width, .height = windowGeometry->height};
 }
 
@@ -218,6 +220,14 @@ auto PlatformProcessEvents(const PlatformProcessEventsCallbacks &callbacks, void
             break;
         }
 
+        case XCB_PROPERTY_NOTIFY: {
+            auto propertynotify = reinterpret_cast<xcb_property_notify_event_t *>(event);
+            if (callbacks.handlePropertyNotify)
+                callbacks.handlePropertyNotify(user, propertynotify->window, propertynotify->atom,
+                                               propertynotify->state == XCB_PROPERTY_DELETE);
+            break;
+        }
+
         case XCB_CLIENT_MESSAGE: {
             auto clientmessage = reinterpret_cast<xcb_client_message_event_t *>(event);
 
@@ -425,9 +435,27 @@ void X11Initialize(bool keyboardInput, bool mouseInput)
     CHECK(x11.screen);
 
     {
-#define X(atom) x11.atoms.atom = X11InternAtom(x11.conn, absl::AsciiStrToUpper(#atom));
+        const uint64_t internStart = GetMonotonicTimeMicros();
+
+        struct
+        {
+#define X(atom) xcb_intern_atom_cookie_t atom;
+            Nyla_X11_Atoms(X) Nyla_X11_NetAtoms(X)
+#undef X
+        } cookies;
+
+#define X(atom) cookies.atom = X11InternAtomRequest(x11.conn, absl::AsciiStrToUpper(#atom));
         Nyla_X11_Atoms(X)
 #undef X
+#define X(atom) cookies.atom = X11InternAtomRequest(x11.conn, "_" + absl::AsciiStrToUpper(#atom));
+        Nyla_X11_NetAtoms(X)
+#undef X
+
+#define X(atom) x11.atoms.atom = X11InternAtomReply(x11.conn, cookies.atom, #atom);
+        Nyla_X11_Atoms(X) Nyla_X11_NetAtoms(X)
+#undef X
+
+        LOG(INFO) << "interned atoms in " << (GetMonotonicTimeMicros() - internStart) << "us";
     }
 
     if (keyboardInput)
@@ -449,12 +477,12 @@ void X11Initialize(bool keyboardInput, bool mouseInput)
         }
 
         xcb_generic_error_t *err = nullptr;
-        if (!Unown(xcb_xkb_per_client_flags_reply(
+        if (!Unown(X11_BLOCKING(xcb_xkb_per_client_flags_reply(
                 x11.conn,
                 xcb_xkb_per_client_flags(x11.conn, XCB_XKB_ID_USE_CORE_KBD,
                                          XCB_XKB_PER_CLIENT_FLAG_DETECTABLE_AUTO_REPEAT,
                                          XCB_XKB_PER_CLIENT_FLAG_DETECTABLE_AUTO_REPEAT, 0, 0, 0),
-                &err)) ||
+                &err))) ||
             err)
         {
             LOG(QFATAL) << "could not set up detectable autorepeat";
@@ -469,22 +497,87 @@ void X11Initialize(bool keyboardInput, bool mouseInput)
             LOG(QFATAL) << "could nolt set up XI2 extension";
         }
 
-        struct
+        if (X11_BLOCKING(xcb_request_check(x11.conn, X11SelectRawMotion(true))))
         {
-            xcb_input_event_mask_t eventMask;
-            uint32_t maskBits;
-        } mask;
+            LOG(QFATAL) << "could not setup XI2 extension";
+        }
+    }
+}
+
+auto X11SelectRawMotion(bool enable) -> xcb_void_cookie_t
+{
+    struct
+    {
+        xcb_input_event_mask_t eventMask;
+        uint32_t maskBits;
+    } mask;
 
-        mask.eventMask.deviceid = XCB_INPUT_DEVICE_ALL_MASTER;
-        mask.eventMask.mask_len = 1;
-        mask.maskBits = XCB_INPUT_XI_EVENT_MASK_RAW_MOTION;
+    mask.eventMask.deviceid = XCB_INPUT_DEVICE_ALL_MASTER;
+    mask.eventMask.mask_len = 1;
+    mask.maskBits = enable ? XCB_INPUT_XI_EVENT_MASK_RAW_MOTION : 0;
+
+    return xcb_input_xi_select_events_checked(x11.conn, x11.screen->root, 1, &mask.eventMask);
+}
+
+auto X11InitializeRandr() -> bool
+{
+    const xcb_query_extension_reply_t *ext = xcb_get_extension_data(x11.conn, &xcb_randr_id);
+    if (!ext || !ext->present)
+        return false;
+
+    xcb_randr_query_version_reply_t *version =
+        X11_BLOCKING(xcb_randr_query_version_reply(x11.conn, xcb_randr_query_version(x11.conn, 1, 5), nullptr));
+    if (!version)
+        return false;
+    absl::Cleanup versionFreer = [version] -> void { free(version); };
+
+    if (version->major_version < 1 || (version->major_version == 1 && version->minor_version < 5))
+    {
+        LOG(WARNING) << "RandR " << version->major_version << "." << version->minor_version
+                     << " has no monitors, treating the screen as one output";
+        return false;
+    }
 
-        if (xcb_request_check(x11.conn,
-                              xcb_input_xi_select_events_checked(x11.conn, x11.screen->root, 1, &mask.eventMask)))
+    xcb_randr_select_input(x11.conn, x11.screen->root, XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE);
+    x11.extRandr = ext;
+    return true;
+}
+
+auto X11QueryMonitors() -> std::vector<X11Monitor>
+{
+    std::vector<X11Monitor> monitors;
+
+    if (x11.extRandr)
+    {
+        xcb_randr_get_monitors_reply_t *reply = X11_BLOCKING(
+            xcb_randr_get_monitors_reply(x11.conn, xcb_randr_get_monitors(x11.conn, x11.screen->root, true), nullptr));
+        if (reply)
         {
-            LOG(QFATAL) << "could not setup XI2 extension";
+            absl::Cleanup replyFreer = [reply] -> void { free(reply); };
+
+            for (auto it = xcb_randr_get_monitors_monitors_iterator(reply); it.rem; xcb_randr_monitor_info_next(&it))
+            {
+                monitors.emplace_back(X11Monitor{
+                    .name = it.data->name,
+                    .x = it.data->x,
+                    .y = it.data->y,
+                    .width = it.data->width,
+                    .height = it.data->height,
+                    .primary = static_cast<bool>(it.data->primary),
+                });
+            }
         }
     }
+
+    if (monitors.empty())
+    {
+        monitors.emplace_back(X11Monitor{
+            .width = x11.screen->width_in_pixels,
+            .height = x11.screen->height_in_pixels,
+            .primary = true,
+        });
+    }
+    return monitors;
 }
 
 auto X11CreateWindow(uint32_t width, uint32_t height, bool overrideRedirect, xcb_event_mask_t eventMask) -> xcb_window_t
@@ -507,8 +600,18 @@ void X11Flush()
 
 auto X11InternAtom(xcb_connection_t *conn, std::string_view name, bool onlyIfExists) -> xcb_atom_t
 {
-    xcb_intern_atom_reply_t *reply =
-        xcb_intern_atom_reply(conn, xcb_intern_atom(conn, onlyIfExists, name.size(), name.data()), nullptr);
+    return X11InternAtomReply(conn, X11InternAtomRequest(conn, name, onlyIfExists), name);
+}
+
+auto X11InternAtomRequest(xcb_connection_t *conn, std::string_view name, bool onlyIfExists)
+    -> xcb_intern_atom_cookie_t
+{
+    return xcb_intern_atom(conn, onlyIfExists, name.size(), name.data());
+}
+
+auto X11InternAtomReply(xcb_connection_t *conn, xcb_intern_atom_cookie_t cookie, std::string_view name) -> xcb_atom_t
+{
+    xcb_intern_atom_reply_t *reply = X11_BLOCKING(xcb_intern_atom_reply(conn, cookie, nullptr));
     absl::Cleanup replyFreer = [reply] -> void {
         if (reply)
             free(reply);
@@ -595,6 +698,30 @@ auto X11ResolveKeyCode(const X11KeyResolver &keyResolver, std::string_view keyna
     return keycode;
 }
 
+auto X11ResolveModifierMask(const X11KeyResolver &keyResolver, std::string_view keyname) -> uint16_t
+{
+    const xkb_keycode_t keycode = xkb_keymap_key_by_name(keyResolver.keymap, keyname.data());
+    if (!xkb_keycode_is_legal_x11(keycode))
+        return 0;
+
+    xcb_get_modifier_mapping_reply_t *reply =
+        X11_BLOCKING(xcb_get_modifier_mapping_reply(x11.conn, xcb_get_modifier_mapping(x11.conn), nullptr));
+    if (!reply)
+        return 0;
+    absl::Cleanup replyFreer = [reply] -> void { free(reply); };
+
+    const xcb_keycode_t *keycodes = xcb_get_modifier_mapping_keycodes(reply);
+    for (uint32_t mod = 0; mod < 8; ++mod)
+    {
+        for (uint32_t i = 0; i < reply->keycodes_per_modifier; ++i)
+        {
+            if (keycodes[mod * reply->keycodes_per_modifier + i] == keycode)
+                return 1 << mod;
+        }
+    }
+    return 0;
+}
+
 } // namespace platform_x11_internal
 
 } // namespace nyla
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string_view>
+#include <vector>
 
 #include "nyla/platform/key_physical.h"
 #include "xcb/xcb.h"
@@ -18,6 +19,15 @@ namespace nyla::platform_x11_internal
     X(wm_name)                                                                                                         \
     X(wm_state)                                                                                                        \
     X(wm_take_focus)
+
+// Interned with a leading underscore, e.g. net_wm_state is _NET_WM_STATE.
+#define Nyla_X11_NetAtoms(X)                                                                                           \
+    X(net_supported)                                                                                                   \
+    X(net_supporting_wm_check)                                                                                         \
+    X(net_wm_state)                                                                                                    \
+    X(net_wm_state_fullscreen)                                                                                         \
+    X(net_wm_state_hidden)                                                                                             \
+    X(nyla_wm_game_mode)
 // NOLINTEND
 
 struct X11State
@@ -26,17 +36,35 @@ struct X11State
     xcb_screen_t *screen;
 
     const xcb_query_extension_reply_t *extXi2;
+    const xcb_query_extension_reply_t *extRandr;
 
     struct
     {
 #define X(atom) xcb_atom_t atom;
         Nyla_X11_Atoms(X)
+        Nyla_X11_NetAtoms(X)
 #undef X
     } atoms;
 };
 extern X11State x11;
 
 void X11Initialize(bool keyboardInput, bool mouseInput);
+auto X11SelectRawMotion(bool enable) -> xcb_void_cookie_t;
+
+struct X11Monitor
+{
+    xcb_atom_t name;
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    bool primary;
+};
+
+// Sets x11.extRandr and selects RRScreenChangeNotify on the root window. Returns false if the server lacks RandR 1.5,
+// X11QueryMonitors then reports the whole screen as a single unnamed monitor.
+auto X11InitializeRandr() -> bool;
+auto X11QueryMonitors() -> std::vector<X11Monitor>;
 
 auto X11CreateWindow(uint32_t width, uint32_t height, bool overrideRedirect, xcb_event_mask_t eventMask)
     -> xcb_window_t;
@@ -44,6 +72,9 @@ auto X11CreateWindow(uint32_t width, uint32_t height, bool overrideRedirect, xcb
 void X11Flush();
 
 auto X11InternAtom(xcb_connection_t *conn, std::string_view name, bool onlyIfExists = false) -> xcb_atom_t;
+auto X11InternAtomRequest(xcb_connection_t *conn, std::string_view name, bool onlyIfExists = false)
+    -> xcb_intern_atom_cookie_t;
+auto X11InternAtomReply(xcb_connection_t *conn, xcb_intern_atom_cookie_t cookie, std::string_view name) -> xcb_atom_t;
 
 void X11SendClientMessage32(xcb_window_t window, xcb_atom_t type, xcb_atom_t arg1, uint32_t arg2, uint32_t arg3,
                             uint32_t arg4);
@@ -66,6 +97,7 @@ struct X11KeyResolver
 auto X11InitializeKeyResolver(X11KeyResolver &resolver) -> bool;
 void X11FreeKeyResolver(X11KeyResolver &resolver);
 auto X11ResolveKeyCode(const X11KeyResolver &resolver, std::string_view keyname) -> xcb_keycode_t;
+auto X11ResolveModifierMask(const X11KeyResolver &resolver, std::string_view keyname) -> uint16_t;
 
 auto ConvertKeyPhysicalIntoXkbName(KeyPhysical key) -> const char *;
 
@@ -0,0 +1,67 @@
+#include "nyla/platform/x11/platform_x11_audit.h"
+
+#if defined(NYLA_X11_AUDIT_ROUND_TRIPS)
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "nyla/commons/os/clock.h"
+
+namespace nyla::platform_x11_internal
+{
+
+static std::deque<X11RoundTripSite> roundTripSites;
+static uint64_t roundTripsResetMicros = GetMonotonicTimeMicros();
+
+auto X11RoundTripSiteRegister(const char *file, uint32_t line) -> X11RoundTripSite &
+{
+    return roundTripSites.emplace_back(X11RoundTripSite{.file = file, .line = line});
+}
+
+auto X11DumpRoundTrips() -> std::string
+{
+    const double elapsedSeconds = std::max<uint64_t>(1, GetMonotonicTimeMicros() - roundTripsResetMicros) / 1e6;
+
+    std::vector<const X11RoundTripSite *> sites;
+    uint64_t totalCount = 0;
+    uint64_t totalBlockedMicros = 0;
+    for (const X11RoundTripSite &site : roundTripSites)
+    {
+        sites.emplace_back(&site);
+        totalCount += site.count;
+        totalBlockedMicros += site.blockedMicros;
+    }
+    std::ranges::sort(sites, std::ranges::greater{}, &X11RoundTripSite::blockedMicros);
+
+    std::string out = absl::StrFormat("total: round_trips=%v per_second=%.2f blocked_us=%v\n", totalCount,
+                                      totalCount / elapsedSeconds, totalBlockedMicros);
+    for (const X11RoundTripSite *site : sites)
+    {
+        if (!site->count)
+            continue;
+
+        absl::StrAppendFormat(&out, "%s:%v: round_trips=%v per_second=%.2f blocked_us=%v max_us=%v\n", site->file,
+                              site->line, site->count, site->count / elapsedSeconds, site->blockedMicros,
+                              site->maxMicros);
+    }
+    return out;
+}
+
+void X11ResetRoundTrips()
+{
+    for (X11RoundTripSite &site : roundTripSites)
+    {
+        site.count = 0;
+        site.blockedMicros = 0;
+        site.maxMicros = 0;
+    }
+    roundTripsResetMicros = GetMonotonicTimeMicros();
+}
+
+} // namespace nyla::platform_x11_internal
+
+#endif
\ No newline at end of file
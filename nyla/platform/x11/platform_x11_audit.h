@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "nyla/commons/os/clock.h"
+
+namespace nyla::platform_x11_internal
+{
+
+// X11_BLOCKING wraps an expression that waits on the X server, e.g. a *_reply call or xcb_request_check. With the
+// NYLA_X11_AUDIT_ROUND_TRIPS build option every call site counts its round trips and the time spent blocked in them,
+// otherwise the macro expands to the bare expression.
+
+#if defined(NYLA_X11_AUDIT_ROUND_TRIPS)
+
+struct X11RoundTripSite
+{
+    const char *file;
+    uint32_t line;
+    uint64_t count;
+    uint64_t blockedMicros;
+    uint64_t maxMicros;
+};
+
+auto X11RoundTripSiteRegister(const char *file, uint32_t line) -> X11RoundTripSite &;
+
+// Call sites sorted by cumulative blocked time, rates are per second since the last reset.
+auto X11DumpRoundTrips() -> std::string;
+void X11ResetRoundTrips();
+
+auto X11AuditBlocking(X11RoundTripSite &site, auto fn)
+{
+    const uint64_t start = GetMonotonicTimeMicros();
+    auto ret = fn();
+    const uint64_t blocked = GetMonotonicTimeMicros() - start;
+
+    ++site.count;
+    site.blockedMicros += blocked;
+    site.maxMicros = std::max(site.maxMicros, blocked);
+    return ret;
+}
+
+#define X11_BLOCKING(expr)                                                                                             \
+    ::nyla::platform_x11_internal::X11AuditBlocking(                                                                   \
+        [] -> ::nyla::platform_x11_internal::X11RoundTripSite & {                                                      \
+            static ::nyla::platform_x11_internal::X11RoundTripSite &site =                                             \
+                ::nyla::platform_x11_internal::X11RoundTripSiteRegister(__FILE__, __LINE__);                           \
+            return site;                                                                                               \
+        }(),                                                                                                           \
+        [&] -> auto { return (expr); })
+
+#else
+
+#define X11_BLOCKING(expr) (expr)
+
+#endif
+
+} // namespace nyla::platform_x11_internal
\ No newline at end of file
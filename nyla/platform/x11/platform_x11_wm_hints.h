@@ -11,6 +11,13 @@ namespace nyla
 namespace platform_x11_internal
 {
 
+enum class WmState : uint32_t
+{
+    KWithdrawn = 0,
+    KNormal = 1,
+    KIconic = 3,
+};
+
 struct WmHints
 {
     static constexpr uint32_t kInputHint = 1;